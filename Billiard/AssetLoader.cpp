@@ -0,0 +1,55 @@
+#include "StdAfx.h"
+#include "AssetLoader.h"
+
+#include <fstream>
+
+#include "glog\logging.h"
+
+#include "GlslProgram.h"
+
+namespace billiard {
+
+AssetLoader::AssetLoader(const std::string &root, const std::string &bundle) : root_(root) {
+    if (!bundle.empty() && std::ifstream(bundle)) {
+        try {
+            bundle_.reset(new Bundle(bundle));
+            LOG(INFO) << "Using " << bundle << ", " << bundle_->getEntryCount() << " assets";
+        } catch (const std::runtime_error &e) {
+            LOG(WARNING) << e.what() << ", using loose files";
+        }
+    }
+}
+
+bool AssetLoader::exists(const std::string &relative) const {
+    return (bundle_ && bundle_->find(relative)) || std::ifstream(path(relative));
+}
+
+AssetLoader::Text AssetLoader::text(const std::string &relative) {
+    if (auto entry = bundle_ ? bundle_->find(relative) : nullptr) {
+        const auto &bundle = *bundle_;
+        return run<std::string>(relative, [&bundle, entry]() {
+            return std::string(bundle.text(*entry), static_cast<size_t>(entry->size));
+        });
+    }
+
+    auto filename = path(relative);
+    return run<std::string>(relative, [filename]() {
+        return glsl::loadShaderFromFile(filename);
+    });
+}
+
+AssetLoader::Image AssetLoader::image(const std::string &relative) {
+    if (auto entry = bundle_ ? bundle_->find(relative) : nullptr) {
+        const auto &bundle = *bundle_;
+        return run<image::Pixels>(relative, [&bundle, entry]() {
+            return bundle.image(*entry);
+        });
+    }
+
+    auto filename = path(relative);
+    return run<image::Pixels>(relative, [filename]() {
+        return image::load(filename.c_str());
+    });
+}
+
+}
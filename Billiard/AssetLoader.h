@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <unordered_map>
+
+#include "ThreadPool.h"
+#include "Image.h"
+#include "Bundle.h"
+
+namespace billiard {
+
+/**
+* Reads and decodes assets on worker threads. Each asset is loaded once,
+* however many times it is requested, and requests return shared futures
+* the GL thread waits on right before it uploads the data. Requesting
+* everything up front makes startup as long as the slowest asset instead
+* of the sum of all of them. Paths are relative to the assets directory.
+* Assets found in the bundle are served from its mapping, textures without
+* a copy, the rest come from loose files.
+*/
+class AssetLoader
+{
+public:
+    typedef std::shared_future<std::string> Text;
+    typedef std::shared_future<image::Pixels> Image;
+
+private:
+    const std::string root_;
+    std::unique_ptr<Bundle> bundle_;
+
+    std::mutex mutex_;
+    // shared_future<T> by key
+    std::unordered_map<std::string, std::shared_ptr<void>> entries_;
+
+    // last, so workers are joined before the entries they fill go away
+    ThreadPool pool_;
+
+public:
+    // bundle is used if it exists, an empty name means loose files only.
+    AssetLoader(const std::string &root, const std::string &bundle);
+
+    AssetLoader(const AssetLoader &) = delete;
+    AssetLoader &operator=(const AssetLoader &) = delete;
+
+    std::string path(const std::string &relative) const { return root_ + relative; }
+    bool exists(const std::string &relative) const;
+
+    Text text(const std::string &relative);
+    Image image(const std::string &relative);
+
+    /*
+        Runs load on a worker unless key was requested before. A key always
+        stands for the same T, exceptions of load are rethrown by get().
+    */
+    template <typename T>
+    std::shared_future<T> run(const std::string &key, std::function<T()> load) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &entry = entries_[key];
+        if (entry) {
+            return *std::static_pointer_cast<std::shared_future<T>>(entry);
+        }
+
+        auto promise = std::make_shared<std::promise<T>>();
+        auto future = std::make_shared<std::shared_future<T>>(promise->get_future().share());
+        entry = future;
+        pool_.submit([promise, load](int) {
+            try {
+                promise->set_value(load());
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+        });
+        return *future;
+    }
+};
+
+}
@@ -2,16 +2,23 @@
 #include "Ball.h"
 
 #include "utils.h"
+#include "Culling.h"
+#include "Image.h"
+#include "Physics.h"
+#include "GlState.h"
 
 #include <cmath>
 #include <utility>
 #include <cstddef>
+#include <algorithm>
 #include <unordered_map>
 
 #include "glm\gtx\transform.hpp"
 #include "glm\gtc\type_ptr.hpp"
 #include "glm\gtc\matrix_transform.hpp"
 
+#include "glog\logging.h"
+
 #define USE_GL_TESSELATION 1
 
 template <class T>
@@ -141,113 +148,205 @@ namespace {
         return std::make_pair(std::move(verticesVector), std::move(indicesVector));
     }
 
-    void prepareAlbedo(const Texture &albedo, const std::string &filename) {
-        albedo.bind<GL_TEXTURE_2D>();
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-        unsigned int w, h, bpp;
-        auto data = utils::loadPng(filename.c_str(), &w, &h, &bpp);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
-        glBindTexture(GL_TEXTURE_2D, 0);
+    const char *const VERTEX_SHADER = "shaders/sphere.vert";
+    const char *const TESS_CONTROL_SHADER = "shaders/sphere.tesc";
+    const char *const TESS_EVAL_SHADER = "shaders/sphere.tese";
+    const char *const FRAGMENT_SHADER = "shaders/sphere.frag";
+    const char *const MESH = "ball mesh";
+    const char *const PROGRAM = "ball";
+
+    // where each batch starts in the instance buffer
+    const size_t INSTANCE_ALIGNMENT = 16;
+
+    // program flags, in the order their names are given to the library
+    const unsigned SHADOW_PASS = 1 << 0;
+    const unsigned DEPTH_PASS = 1 << 1;
+
+    std::vector<std::string> shaderFiles() {
+        return { VERTEX_SHADER,
+#ifdef USE_GL_TESSELATION
+                 TESS_CONTROL_SHADER, TESS_EVAL_SHADER,
+#endif
+                 FRAGMENT_SHADER };
     }
 
-    glm::mat4 createModelMat() {
-        glm::mat4 modelMat;
-        modelMat = glm::scale(modelMat, glm::vec3(BALL_DIAMETER / 2));
-        modelMat = glm::translate(modelMat, glm::vec3(0, 0, 1));
-        return modelMat;
+    void setupProgram(glsl::Program &program, unsigned flags) {
+        if (flags == 0) {
+            program.bind();
+            program.setUniformInt("u_Albedo", 0);
+            glsl::Program::unbind();
+        }
     }
 
-    void doRender(bool lines, GLuint vao, GLsizei count) {
-        glCullFace(GL_FRONT);
-        glPolygonMode(GL_FRONT_AND_BACK, lines ? GL_LINE : GL_FILL);
+    std::pair<std::vector<GLfloat>, std::vector<GLushort>> createMesh() {
+        return tesselate(vertices, utils::length(vertices), indices, utils::length(indices), 2);
+    }
 
-        glBindVertexArray(vao);
-        glDrawElements(GL_PATCHES, count, GL_UNSIGNED_SHORT, nullptr);
-        glBindVertexArray(0);
+    /* Ball number N gets its own layer when ball_albedo_N.png exists, 
+       the rest share layer 0 with ball_albedo.png. Fills layers by number. */
+    std::vector<std::string> albedoFiles(const AssetLoader &assets, int balls, std::vector<GLint> &layers) {
+        std::vector<std::string> files(1, "textures/ball_albedo.png");
+        layers.clear();
+        for (int i = 0; i < balls; i++) {
+            auto file = "textures/ball_albedo_" + std::to_string(i) + ".png";
+            if (assets.exists(file)) {
+                layers.push_back(static_cast<GLint>(files.size()));
+                files.push_back(file);
+            } else {
+                layers.push_back(0);
+            }
+        }
+        return files;
+    }
+
+    // returns layers by number.
+    std::vector<GLint> prepareAlbedo(const Texture &albedo, AssetLoader &assets, int balls) {
+        std::vector<GLint> layers;
+        auto files = albedoFiles(assets, balls, layers);
+
+        albedo.bind<GL_TEXTURE_2D_ARRAY>();
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // storage first, while no unpack buffer is bound to read it from
+        auto info = assets.image(files[0]).get().info;
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, info.internalFormat(), info.width, info.height,
+            static_cast<GLsizei>(files.size()), 0, info.format(), GL_UNSIGNED_BYTE, nullptr);
+
+        // base levels only, mips of packed layers are not used
+        image::Uploader uploader;
+        for (GLint layer = 0; layer < static_cast<GLint>(files.size()); layer++) {
+            const auto &pixels = assets.image(files[layer]).get();
+            const auto &layerInfo = pixels.info;
+            if (layerInfo.width != info.width || layerInfo.height != info.height) {
+                LOG(ERROR) << files[layer] << " must be " << info.width << "x" << info.height 
+                    << ", using " << files[0];
+                std::replace(layers.begin(), layers.end(), layer, 0);
+                continue;
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, info.width, info.height, 1,
+                layerInfo.format(), GL_UNSIGNED_BYTE, uploader.source(pixels));
+        }
+        image::Uploader::finish();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return layers;
+    }
+
+    void doRender(bool lines, GLuint vao, GLsizei count, const glsl::Program &program, GLsizei instances) {
+        GlState::cullFace(GL_FRONT);
+        GlState::polygonMode(lines ? GL_LINE : GL_FILL);
+
+        program.bind();
+        GlState::bindVertexArray(vao);
+        glDrawElementsInstanced(GL_PATCHES, count, GL_UNSIGNED_SHORT, nullptr, instances);
     }
 }
 
-Ball::Ball(const std::string &exePath)
-        : programs_(glsl::loadShaderFromFile(exePath + "../assets/shaders/sphere.vert"), 
-#ifdef USE_GL_TESSELATION
-                    glsl::loadShaderFromFile(exePath + "../assets/shaders/sphere.tesc"), 
-                    glsl::loadShaderFromFile(exePath + "../assets/shaders/sphere.tese"), 
-#endif
-                    glsl::loadShaderFromFile(exePath + "../assets/shaders/sphere.frag"))
-        , data_(tesselate(vertices, utils::length(vertices), indices, utils::length(indices), 2))
+void Ball::requestAssets(AssetLoader &assets) {
+    for (const auto &file : shaderFiles()) {
+        assets.text(file);
+    }
+    assets.run<Mesh>(MESH, createMesh);
+
+    std::vector<GLint> layers;
+    for (const auto &file : albedoFiles(assets, BallSystem::MAX_BALLS, layers)) {
+        assets.image(file);
+    }
+}
+
+Ball::Ball(AssetLoader &assets, ProgramLibrary &programs)
+        : programs_(programs.add(PROGRAM, assets, shaderFiles(), { "SHADOW_PASS", "DEPTH_PASS" }, setupProgram))
+        , data_(assets.run<Mesh>(MESH, createMesh).get())
         , vbo_(VertexBuffer::create<GL_ARRAY_BUFFER>(data_.first.data(), data_.first.size()))
         , indices_(VertexBuffer::create<GL_ELEMENT_ARRAY_BUFFER>(data_.second.data(), data_.second.size()))
         , lineFill_(false)
-        , modelMat_(createModelMat()) {
-    glBindVertexArray(vao_);
+        , instanceBuffer_(2 * (BallSystem::MAX_BALLS * sizeof(Instance) + INSTANCE_ALIGNMENT)) {
+    setupBatch(camera_);
+    setupBatch(light_);
+
+    albedoLayers_ = prepareAlbedo(albedo_, assets, BallSystem::MAX_BALLS);
+
+    // every pass runs each frame, submitted together they compile in parallel
+    programs_.prepare(SHADOW_PASS);
+    programs_.prepare(DEPTH_PASS);
+    programs_.prepare(0);
+}
+
+
+void Ball::setupBatch(const Batch &batch) const {
+    glBindVertexArray(batch.vao);
     vbo_.bind<GL_ARRAY_BUFFER>();
     indices_.bind<GL_ELEMENT_ARRAY_BUFFER>();
     glsl::Program::setAttrPtr(0, 3, 0, nullptr);
+
+    pointInstances(batch);
+    for (GLuint column = 0; column < 4; column++) {
+        glVertexAttribDivisor(1 + column, 1);
+    }
+    glEnableVertexAttribArray(5);
+    glVertexAttribDivisor(5, 1);
     glBindVertexArray(0);
     VertexBuffer::unbind<GL_ARRAY_BUFFER>(); 
     VertexBuffer::unbind<GL_ELEMENT_ARRAY_BUFFER>();
+}
 
-    prepareAlbedo(albedo_, exePath + "../assets/textures/ball_albedo.png");
+void Ball::pointInstances(const Batch &batch) const {
+    // model matrix takes locations 1-4, a column each, ball number and layer go to 5.
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer_);
+    for (GLuint column = 0; column < 4; column++) {
+        auto offset = batch.offset + offsetof(Instance, modelMat) + column * sizeof(glm::vec4);
+        glsl::Program::setAttrPtr(1 + column, 4, sizeof(Instance), (void*)offset);
+    }
+    auto offset = batch.offset + offsetof(Instance, number);
+    glVertexAttribIPointer(5, 2, GL_INT, sizeof(Instance), (void*)offset);
 }
 
 void Ball::renderShadow() const {
-    programs_.shadow_.bind();
-    doRender(lineFill_, vao_, data_.second.size());
-    glsl::Program::unbind();
+    doRender(lineFill_, light_.vao, data_.second.size(), programs_.get(SHADOW_PASS), light_.instances.size());
 }
 
 void Ball::render() const {
-    albedo_.bind<GL_TEXTURE_2D>();
-    programs_.normal_.bind();
-    doRender(lineFill_, vao_, data_.second.size());
-    glsl::Program::unbind();
+    GlState::bindTexture(0, GL_TEXTURE_2D_ARRAY, albedo_);
+    doRender(lineFill_, camera_.vao, data_.second.size(), programs_.get(0), camera_.instances.size());
 }
 
 void Ball::renderDepth() const {
-    programs_.depth_.bind();
-    doRender(lineFill_, vao_, data_.second.size());
-    glsl::Program::unbind();
+    doRender(lineFill_, camera_.vao, data_.second.size(), programs_.get(DEPTH_PASS), camera_.instances.size());
+}
+
+void Ball::fillBatch(Batch &batch, const BallSnapshot &balls, const Plane *planes) {
+    int visible[BallSystem::MAX_BALLS];
+    auto count = culling::cullSpheres(planes, 6, balls.posX, balls.posY, 
+        physics::RADIUS, physics::RADIUS, balls.count, visible);
+    batch.culled = balls.count - count;
+
+    batch.instances.resize(count);
+    for (int i = 0; i < count; i++) {
+        auto &instance = batch.instances[i];
+        instance.number = visible[i];
+        instance.modelMat = balls.computeModelMat(instance.number);
+        instance.layer = albedoLayers_[instance.number];
+    }
+    if (batch.instances.empty()) {
+        return;
+    }
+
+    // every frame writes elsewhere, so the attributes follow the instances
+    batch.offset = instanceBuffer_.write(batch.instances.data(),
+        batch.instances.size() * sizeof(Instance), INSTANCE_ALIGNMENT);
+    GlState::bindVertexArray(batch.vao);
+    pointInstances(batch);
+    VertexBuffer::unbind<GL_ARRAY_BUFFER>();
 }
 
-void Ball::update(const Frustum &frustum, const ConeLight &light) {
-    const auto &view = frustum.getView();
-    auto modelView = view * modelMat_;
-    auto modelViewInv = glm::inverse(modelView);
-    auto cameraWorldPos = modelViewInv * glm::vec4(0, 0, 0, 1);
-    cameraWorldPos /= cameraWorldPos.w;
-    
-    auto normalMat = glm::transpose(glm::inverse(glm::mat3(modelView)));
-    auto modelViewProj = frustum.getProj() * modelView;
-
-    programs_.normal_.bind();
-    programs_.normal_.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(modelViewProj));
-    programs_.normal_.setUniformMat4("u_ModelMat", false, glm::value_ptr(modelMat_));
-    programs_.normal_.setUniformMat4("u_ModelViewMat", false, glm::value_ptr(modelView));
-    programs_.normal_.setUniformMat3("u_NormalMat", false, glm::value_ptr(normalMat));
-    programs_.normal_.setUniformVec3("u_CameraWorldPos", glm::value_ptr(cameraWorldPos));
-    programs_.normal_.setUniformInt("u_Albedo", 0);
-    light.bind(programs_.normal_, frustum);
-
-    depthModelViewProj_ = light.computeProjViewMat() * modelMat_;
-    
-    programs_.shadow_.bind();
-    programs_.shadow_.setUniformMat4("u_ModelMat", false, glm::value_ptr(modelMat_));
-    programs_.shadow_.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(depthModelViewProj_));
-    programs_.shadow_.setUniformVec3("u_CameraWorldPos", glm::value_ptr(cameraWorldPos));
-
-    programs_.depth_.bind();
-    programs_.depth_.setUniformMat4("u_ModelMat", false, glm::value_ptr(modelMat_));
-    programs_.depth_.setUniformMat4("u_ModelViewMat", false, glm::value_ptr(modelView));
-    programs_.depth_.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(modelViewProj));
-    programs_.depth_.setUniformVec3("u_CameraWorldPos", glm::value_ptr(cameraWorldPos));
-    programs_.depth_.setUniformFloat("u_NearPlane", frustum.getNear());
-    programs_.depth_.setUniformFloat("u_FarPlane", frustum.getFar());
-
-    glsl::Program::unbind();
+void Ball::update(const BallSnapshot &previous, const BallSnapshot &latest, float alpha,
+        const Frustum &camera, const Plane (&lightPlanes)[6]) {
+    BallSnapshot::interpolate(previous, latest, alpha, interpolated_);
+    instanceBuffer_.beginFrame();
+    fillBatch(camera_, interpolated_, camera.getPlanes());
+    fillBatch(light_, interpolated_, lightPlanes);
 }
 
 void Ball::setLineFill(bool value) {
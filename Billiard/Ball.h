@@ -7,53 +7,72 @@
 #include "VertexBuffer.h"
 #include "GlslProgram.h"
 #include "Frustum.h"
+#include "Plane.h"
 #include "Texture.h"
-#include "ConeLight.h"
-
-#define BALL_DIAMETER 0.68f
+#include "BallSnapshot.h"
+#include "Dimensions.h"
+#include "AssetLoader.h"
+#include "ProgramLibrary.h"
+#include "DynamicBuffer.h"
 
 namespace billiard {
 
 class Ball
 {
-    class Programs {
-        Programs(const Programs&) = delete;
-        Programs& operator=(const Programs&) = delete;
-    public:
-        const glsl::Program shadow_;
-        const glsl::Program normal_;
-        const glsl::Program depth_;
-
-        Programs(const std::string &vertexSource, const std::string &tessControlSource,
-                const std::string &tessEvalSource, const std::string &fragmentSource) 
-                : shadow_("#define SHADOW_PASS\n", vertexSource, tessControlSource, tessEvalSource, fragmentSource)
-                , depth_("#define DEPTH_PASS\n", vertexSource, tessControlSource, tessEvalSource, fragmentSource)
-                , normal_("", vertexSource, tessControlSource, tessEvalSource, fragmentSource) {
-        }
-    };
-
-    const std::pair<std::vector<GLfloat>, std::vector<GLushort>> data_;
+    typedef std::pair<std::vector<GLfloat>, std::vector<GLushort>> Mesh;
+    ProgramVariants &programs_; // shared through the library
+    const Mesh data_;
 
-    const VertexArray vao_;
     const VertexBuffer vbo_;
     const VertexBuffer indices_;
-    const Programs programs_;
-    const Texture albedo_;
+    const Texture albedo_; // texture array
+    std::vector<GLint> albedoLayers_; // by ball number
     bool lineFill_;
 
-    const glm::mat4 modelMat_;
-    glm::mat4 depthModelViewProj_;
+    // per ball vertex attributes, camera and light come from FrameUniforms.
+    struct Instance {
+        glm::mat4 modelMat;
+        GLint number;
+        GLint layer;
+    };
+
+    // balls inside one view volume, each pass draws its batch at once.
+    struct Batch {
+        VertexArray vao;
+        std::vector<Instance> instances;
+        GLintptr offset; // of the instances in instanceBuffer_, the attributes point there
+        int culled;
+
+        Batch() : offset(0), culled(0) {}
+    };
+    Batch camera_; // main and depth passes
+    Batch light_; // shadow pass
+    DynamicBuffer instanceBuffer_; // both batches, rewritten every frame
+    BallSnapshot interpolated_;
+
+    void setupBatch(const Batch &batch) const;
+    void pointInstances(const Batch &batch) const;
+    void fillBatch(Batch &batch, const BallSnapshot &balls, const Plane *planes);
 public:
-    Ball(const std::string &exePath);
+    Ball(AssetLoader &assets, ProgramLibrary &programs);
+
+    // starts loading and tesselating what the constructor needs.
+    static void requestAssets(AssetLoader &assets);
 
     void render() const;
     void renderShadow() const;
     void renderDepth() const;
 
     void setLineFill(bool value);
-    void update(const Frustum &frustum, const ConeLight &light);
 
-    const glm::mat4 getDepthModelViewProj() const { return depthModelViewProj_; }
+    // renders balls at alpha between two steps, culled against the camera
+    // and the light view volumes.
+    void update(const BallSnapshot &previous, const BallSnapshot &latest, float alpha,
+        const Frustum &camera, const Plane (&lightPlanes)[6]);
+
+    int getCameraCulled() const { return camera_.culled; }
+    int getLightCulled() const { return light_.culled; }
+    int getInstanceStalls() const { return instanceBuffer_.getStalls(); }
 };
 
 }
\ No newline at end of file
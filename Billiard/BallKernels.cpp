@@ -0,0 +1,252 @@
+#include "StdAfx.h"
+#include "BallKernels.h"
+
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "CpuFeatures.h"
+#include "Physics.h"
+
+namespace billiard {
+namespace kernels {
+
+using namespace physics;
+
+namespace {
+    const float ALPHA = 2.5f / RADIUS;
+    const float SLIDING_ACCEL = SLIDING_FRICTION * GRAVITY;
+
+    /*
+        Every operation below has a packed counterpart in the SSE and AVX2
+        kernels, in the same order, so all kernel sets round the same way.
+    */
+    void integrateBall(float &px, float &py, float &vx, float &vy,
+            float &wx, float &wy, float &wz, float dt) {
+        // sliding until the contact point stops
+        auto ux = vx - RADIUS * wy;
+        auto uy = vy + RADIUS * wx;
+        auto slip = std::sqrt(ux * ux + uy * uy);
+        auto sliding = slip > EPSILON;
+
+        auto limit = slip / SLIDING_DECEL;
+        auto slideDone = sliding && limit <= dt;
+        auto tau = sliding ? std::min(limit, dt) : 0.0f;
+        auto k = -SLIDING_ACCEL / std::max(slip, EPSILON);
+        auto ax = sliding ? ux * k : 0.0f;
+        auto ay = sliding ? uy * k : 0.0f;
+
+        auto half = 0.5f * tau * tau;
+        px = px + vx * tau + ax * half;
+        py = py + vy * tau + ay * half;
+        vx = vx + ax * tau;
+        vy = vy + ay * tau;
+        wx = wx + ALPHA * ay * tau;
+        wy = wy - ALPHA * ax * tau;
+        if (slideDone) {
+            wx = -vy / RADIUS;
+            wy = vx / RADIUS;
+        }
+
+        // rolling for the rest of dt until the ball stops
+        auto rest = dt - tau;
+        auto speed = std::sqrt(vx * vx + vy * vy);
+        auto rolling = (!sliding || slideDone) && speed > EPSILON;
+
+        auto limitR = speed / ROLLING_DECEL;
+        auto rollDone = rolling && limitR <= rest;
+        auto tauR = rolling ? std::min(limitR, rest) : 0.0f;
+        auto kR = -ROLLING_DECEL / std::max(speed, EPSILON);
+        auto bx = rolling ? vx * kR : 0.0f;
+        auto by = rolling ? vy * kR : 0.0f;
+
+        auto halfR = 0.5f * tauR * tauR;
+        px = px + vx * tauR + bx * halfR;
+        py = py + vy * tauR + by * halfR;
+        vx = vx + bx * tauR;
+        vy = vy + by * tauR;
+        if (rolling) {
+            wx = -vy / RADIUS;
+            wy = vx / RADIUS;
+        }
+        if (rollDone) {
+            vx = vy = wx = wy = 0;
+        }
+
+        // spin around z decays independently
+        auto dw = SPIN_DECEL * dt;
+        wz = std::fabs(wz) <= dw ? 0.0f : (wz > 0 ? wz - dw : wz + dw);
+    }
+
+    void integrateScalar(const BallArrays &b, float dt) {
+        for (int i = 0; i < b.count; i++) {
+            integrateBall(b.posX[i], b.posY[i], b.velX[i], b.velY[i],
+                    b.angX[i], b.angY[i], b.angZ[i], dt);
+        }
+    }
+
+    int findContactsScalar(const float *x, const float *y, int count, float minDist,
+            unsigned short *contacts) {
+        auto min2 = minDist * minDist;
+        int pairs = 0;
+        for (int i = 0; i < count; i++) {
+            unsigned int bits = 0;
+            for (int j = i + 1; j < count; j++) {
+                auto dx = x[j] - x[i];
+                auto dy = y[j] - y[i];
+                if (dx * dx + dy * dy < min2) {
+                    bits |= 1u << j;
+                    pairs++;
+                }
+            }
+            contacts[i] = static_cast<unsigned short>(bits);
+        }
+        return pairs;
+    }
+
+    std::atomic<bool> deterministic(false);
+
+    const int BENCH_BALLS = 16;
+
+    struct alignas(32) BenchState {
+        float posX[BENCH_BALLS];
+        float posY[BENCH_BALLS];
+        float velX[BENCH_BALLS];
+        float velY[BENCH_BALLS];
+        float angX[BENCH_BALLS];
+        float angY[BENCH_BALLS];
+        float angZ[BENCH_BALLS];
+
+        BallArrays arrays() {
+            BallArrays result = { posX, posY, velX, velY, angX, angY, angZ, BENCH_BALLS };
+            return result;
+        }
+    };
+
+    // a break like spread: fixed seed, so every run measures the same work.
+    void fillBench(BenchState &s) {
+        unsigned int seed = 12345;
+        auto next = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / (1 << 24) - 0.5f;
+        };
+        for (int i = 0; i < BENCH_BALLS; i++) {
+            s.posX[i] = next() * TABLE_WIDTH * 0.5f;
+            s.posY[i] = next() * TABLE_HEIGHT * 0.5f;
+            s.velX[i] = next() * 40;
+            s.velY[i] = next() * 40;
+            s.angX[i] = next() * 40;
+            s.angY[i] = next() * 40;
+            s.angZ[i] = next() * 40;
+        }
+    }
+
+    template <typename F>
+    double timeIt(int iterations, F f) {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            f();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count();
+    }
+}
+
+Isa detectIsa() {
+    if (!cpu::hasSse2()) {
+        return Isa::Scalar;
+    }
+    return cpu::hasAvx2() ? Isa::Avx2 : Isa::Sse;
+}
+
+const Kernels &scalarKernels() {
+    static const Kernels kernels = { "scalar", integrateScalar, findContactsScalar };
+    return kernels;
+}
+
+const Kernels &activeKernels() {
+    static const Kernels &detected = [] () -> const Kernels & {
+        switch (detectIsa()) {
+        case Isa::Avx2:
+            return avx2Kernels();
+        case Isa::Sse:
+            return sseKernels();
+        default:
+            return scalarKernels();
+        }
+    }();
+    return deterministic ? scalarKernels() : detected;
+}
+
+void setDeterministic(bool value) {
+    deterministic = value;
+}
+
+bool isDeterministic() {
+    return deterministic;
+}
+
+void runBenchmark(std::ostream &out) {
+    const int iterations = 2000000;
+    const int pairsPerCall = BENCH_BALLS * (BENCH_BALLS - 1) / 2;
+    const float dt = 1e-4f;
+
+    std::vector<const Kernels *> sets;
+    sets.push_back(&scalarKernels());
+    auto isa = detectIsa();
+    if (isa == Isa::Sse || isa == Isa::Avx2) {
+        sets.push_back(&sseKernels());
+    }
+    if (isa == Isa::Avx2) {
+        sets.push_back(&avx2Kernels());
+    }
+
+    BenchState reference;
+    fillBench(reference);
+    for (int i = 0; i < 1000; i++) {
+        scalarKernels().integrate(reference.arrays(), dt);
+    }
+
+    double scalarPairs = 0;
+    double scalarBalls = 0;
+    for (auto kernels : sets) {
+        BenchState s;
+        fillBench(s);
+
+        unsigned short contacts[BENCH_BALLS];
+        volatile int sink = 0;
+        auto contactTime = timeIt(iterations, [&]() {
+            sink += kernels->findContacts(s.posX, s.posY, BENCH_BALLS, BALL_DIAMETER * 4, contacts);
+        });
+
+        // integration changes the state, so it is checked against scalar first.
+        for (int i = 0; i < 1000; i++) {
+            kernels->integrate(s.arrays(), dt);
+        }
+        auto identical = std::memcmp(&s, &reference, sizeof(s)) == 0;
+
+        auto arrays = s.arrays();
+        auto integrateTime = timeIt(iterations / 4, [&]() {
+            kernels->integrate(arrays, dt);
+        });
+
+        auto pairsPerSecond = iterations * pairsPerCall / contactTime;
+        auto ballsPerSecond = iterations / 4 * BENCH_BALLS / integrateTime;
+        if (kernels == sets.front()) {
+            scalarPairs = pairsPerSecond;
+            scalarBalls = ballsPerSecond;
+        }
+
+        out << kernels->name << ": " << pairsPerSecond / 1e6 << " M pairs/s ("
+            << pairsPerSecond / scalarPairs << "x), "
+            << ballsPerSecond / 1e6 << " M balls/s ("
+            << ballsPerSecond / scalarBalls << "x), "
+            << (identical ? "matches scalar" : "DIFFERS from scalar") << std::endl;
+    }
+}
+
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <ostream>
+
+namespace billiard {
+namespace kernels {
+
+/**
+* Views of BallSystem arrays. Arrays are padded to MAX_BALLS, so kernels
+* may read and write whole vectors past count. BallSystem may live on the
+* heap, which is only 8 byte aligned on Win32, so vectors are moved with
+* unaligned loads and stores.
+*/
+struct BallArrays {
+    float *posX;
+    float *posY;
+    float *velX;
+    float *velY;
+    float *angX;
+    float *angY;
+    float *angZ;
+    int count;
+};
+
+/*
+    Moves all balls by dt under friction only. Each ball may slide, then
+    roll, then stop within dt, every phase is integrated exactly. Results
+    are bit identical across all kernel sets.
+*/
+typedef void (*IntegrateFn)(const BallArrays &balls, float dt);
+
+/*
+    Tests all pairs for centers closer than minDist. Bit j of contacts[i] is
+    set for every touching pair i < j. Returns number of touching pairs.
+*/
+typedef int (*ContactsFn)(const float *x, const float *y, int count, float minDist,
+        unsigned short *contacts);
+
+struct Kernels {
+    const char *name;
+    IntegrateFn integrate;
+    ContactsFn findContacts;
+};
+
+enum class Isa {
+    Scalar,
+    Sse,
+    Avx2
+};
+
+// instruction set supported by both CPU and OS.
+Isa detectIsa();
+
+const Kernels &scalarKernels();
+const Kernels &sseKernels();
+const Kernels &avx2Kernels();
+
+// best kernels for this CPU, detected once, or scalar ones when deterministic.
+const Kernels &activeKernels();
+
+/*
+    Pins the scalar kernels. Packed kernels match them on this build, but
+    a different compiler may contract mul and add into FMA in one of them.
+*/
+void setDeterministic(bool deterministic);
+bool isDeterministic();
+
+// times all supported kernel sets against the scalar one.
+void runBenchmark(std::ostream &out);
+
+}
+}
@@ -0,0 +1,143 @@
+#include "StdAfx.h"
+#include "BallKernels.h"
+
+#include <immintrin.h>
+
+#include "Physics.h"
+
+/*
+    Only code in this file uses AVX2, it is called after detectIsa confirmed
+    support. The project is not built with /arch:AVX2, otherwise the compiler
+    could emit AVX in inline functions shared with the rest of the program.
+*/
+#if defined(__GNUC__) && !defined(__AVX2__)
+    #pragma GCC target("avx2")
+#endif
+
+namespace billiard {
+namespace kernels {
+
+using namespace physics;
+
+namespace {
+    // mask ? a : b
+    __m256 select(__m256 mask, __m256 a, __m256 b) {
+        return _mm256_blendv_ps(b, a, mask);
+    }
+
+    // eight balls per iteration, mirrors integrateBall in BallKernels.cpp.
+    void integrateAvx2(const BallArrays &b, float dt) {
+        const auto radius = _mm256_set1_ps(RADIUS);
+        const auto epsilon = _mm256_set1_ps(EPSILON);
+        const auto alpha = _mm256_set1_ps(2.5f / RADIUS);
+        const auto half = _mm256_set1_ps(0.5f);
+        const auto signBit = _mm256_set1_ps(-0.0f);
+        const auto allOnes = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        const auto vdt = _mm256_set1_ps(dt);
+        const auto dw = _mm256_set1_ps(SPIN_DECEL * dt);
+
+        for (int i = 0; i < b.count; i += 8) {
+            auto px = _mm256_loadu_ps(b.posX + i);
+            auto py = _mm256_loadu_ps(b.posY + i);
+            auto vx = _mm256_loadu_ps(b.velX + i);
+            auto vy = _mm256_loadu_ps(b.velY + i);
+            auto wx = _mm256_loadu_ps(b.angX + i);
+            auto wy = _mm256_loadu_ps(b.angY + i);
+            auto wz = _mm256_loadu_ps(b.angZ + i);
+
+            auto ux = _mm256_sub_ps(vx, _mm256_mul_ps(radius, wy));
+            auto uy = _mm256_add_ps(vy, _mm256_mul_ps(radius, wx));
+            auto slip = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(ux, ux), _mm256_mul_ps(uy, uy)));
+            auto sliding = _mm256_cmp_ps(slip, epsilon, _CMP_GT_OQ);
+
+            auto limit = _mm256_div_ps(slip, _mm256_set1_ps(SLIDING_DECEL));
+            auto slideDone = _mm256_and_ps(sliding, _mm256_cmp_ps(limit, vdt, _CMP_LE_OQ));
+            auto tau = _mm256_and_ps(sliding, _mm256_min_ps(limit, vdt));
+            auto k = _mm256_div_ps(_mm256_set1_ps(-SLIDING_FRICTION * GRAVITY), _mm256_max_ps(slip, epsilon));
+            auto ax = _mm256_and_ps(sliding, _mm256_mul_ps(ux, k));
+            auto ay = _mm256_and_ps(sliding, _mm256_mul_ps(uy, k));
+
+            auto tt = _mm256_mul_ps(_mm256_mul_ps(half, tau), tau);
+            px = _mm256_add_ps(_mm256_add_ps(px, _mm256_mul_ps(vx, tau)), _mm256_mul_ps(ax, tt));
+            py = _mm256_add_ps(_mm256_add_ps(py, _mm256_mul_ps(vy, tau)), _mm256_mul_ps(ay, tt));
+            vx = _mm256_add_ps(vx, _mm256_mul_ps(ax, tau));
+            vy = _mm256_add_ps(vy, _mm256_mul_ps(ay, tau));
+            wx = _mm256_add_ps(wx, _mm256_mul_ps(_mm256_mul_ps(alpha, ay), tau));
+            wy = _mm256_sub_ps(wy, _mm256_mul_ps(_mm256_mul_ps(alpha, ax), tau));
+            wx = select(slideDone, _mm256_div_ps(_mm256_xor_ps(vy, signBit), radius), wx);
+            wy = select(slideDone, _mm256_div_ps(vx, radius), wy);
+
+            auto rest = _mm256_sub_ps(vdt, tau);
+            auto speed = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+            auto rolling = _mm256_and_ps(_mm256_or_ps(_mm256_andnot_ps(sliding, allOnes), slideDone),
+                    _mm256_cmp_ps(speed, epsilon, _CMP_GT_OQ));
+
+            auto limitR = _mm256_div_ps(speed, _mm256_set1_ps(ROLLING_DECEL));
+            auto rollDone = _mm256_and_ps(rolling, _mm256_cmp_ps(limitR, rest, _CMP_LE_OQ));
+            auto tauR = _mm256_and_ps(rolling, _mm256_min_ps(limitR, rest));
+            auto kR = _mm256_div_ps(_mm256_set1_ps(-ROLLING_DECEL), _mm256_max_ps(speed, epsilon));
+            auto bx = _mm256_and_ps(rolling, _mm256_mul_ps(vx, kR));
+            auto by = _mm256_and_ps(rolling, _mm256_mul_ps(vy, kR));
+
+            auto ttR = _mm256_mul_ps(_mm256_mul_ps(half, tauR), tauR);
+            px = _mm256_add_ps(_mm256_add_ps(px, _mm256_mul_ps(vx, tauR)), _mm256_mul_ps(bx, ttR));
+            py = _mm256_add_ps(_mm256_add_ps(py, _mm256_mul_ps(vy, tauR)), _mm256_mul_ps(by, ttR));
+            vx = _mm256_add_ps(vx, _mm256_mul_ps(bx, tauR));
+            vy = _mm256_add_ps(vy, _mm256_mul_ps(by, tauR));
+            wx = select(rolling, _mm256_div_ps(_mm256_xor_ps(vy, signBit), radius), wx);
+            wy = select(rolling, _mm256_div_ps(vx, radius), wy);
+            vx = _mm256_andnot_ps(rollDone, vx);
+            vy = _mm256_andnot_ps(rollDone, vy);
+            wx = _mm256_andnot_ps(rollDone, wx);
+            wy = _mm256_andnot_ps(rollDone, wy);
+
+            auto stopped = _mm256_cmp_ps(_mm256_andnot_ps(signBit, wz), dw, _CMP_LE_OQ);
+            auto decayed = _mm256_sub_ps(wz, _mm256_or_ps(dw, _mm256_and_ps(wz, signBit)));
+            wz = _mm256_andnot_ps(stopped, decayed);
+
+            _mm256_storeu_ps(b.posX + i, px);
+            _mm256_storeu_ps(b.posY + i, py);
+            _mm256_storeu_ps(b.velX + i, vx);
+            _mm256_storeu_ps(b.velY + i, vy);
+            _mm256_storeu_ps(b.angX + i, wx);
+            _mm256_storeu_ps(b.angY + i, wy);
+            _mm256_storeu_ps(b.angZ + i, wz);
+        }
+        // avoids the penalty of switching back to legacy SSE code
+        _mm256_zeroupper();
+    }
+
+    int findContactsAvx2(const float *x, const float *y, int count, float minDist,
+            unsigned short *contacts) {
+        const auto min2 = _mm256_set1_ps(minDist * minDist);
+        const auto valid = (1u << count) - 1;
+        int pairs = 0;
+        for (int i = 0; i < count; i++) {
+            auto xi = _mm256_set1_ps(x[i]);
+            auto yi = _mm256_set1_ps(y[i]);
+            unsigned int bits = 0;
+            for (int j = 0; j < count; j += 8) {
+                auto dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), xi);
+                auto dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), yi);
+                auto d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+                bits |= static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(d2, min2, _CMP_LT_OQ))) << j;
+            }
+            // only pairs with j > i
+            bits &= valid & ~((2u << i) - 1);
+            contacts[i] = static_cast<unsigned short>(bits);
+            for (; bits; bits &= bits - 1) {
+                pairs++;
+            }
+        }
+        _mm256_zeroupper();
+        return pairs;
+    }
+}
+
+const Kernels &avx2Kernels() {
+    static const Kernels kernels = { "avx2", integrateAvx2, findContactsAvx2 };
+    return kernels;
+}
+
+}
+}
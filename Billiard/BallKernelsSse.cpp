@@ -0,0 +1,131 @@
+#include "StdAfx.h"
+#include "BallKernels.h"
+
+#include <emmintrin.h>
+
+#include "Physics.h"
+
+namespace billiard {
+namespace kernels {
+
+using namespace physics;
+
+namespace {
+    // mask ? a : b
+    __m128 select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    // four balls per iteration, mirrors integrateBall in BallKernels.cpp.
+    void integrateSse(const BallArrays &b, float dt) {
+        const auto radius = _mm_set1_ps(RADIUS);
+        const auto epsilon = _mm_set1_ps(EPSILON);
+        const auto alpha = _mm_set1_ps(2.5f / RADIUS);
+        const auto half = _mm_set1_ps(0.5f);
+        const auto signBit = _mm_set1_ps(-0.0f);
+        const auto allOnes = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        const auto vdt = _mm_set1_ps(dt);
+        const auto dw = _mm_set1_ps(SPIN_DECEL * dt);
+
+        for (int i = 0; i < b.count; i += 4) {
+            auto px = _mm_loadu_ps(b.posX + i);
+            auto py = _mm_loadu_ps(b.posY + i);
+            auto vx = _mm_loadu_ps(b.velX + i);
+            auto vy = _mm_loadu_ps(b.velY + i);
+            auto wx = _mm_loadu_ps(b.angX + i);
+            auto wy = _mm_loadu_ps(b.angY + i);
+            auto wz = _mm_loadu_ps(b.angZ + i);
+
+            auto ux = _mm_sub_ps(vx, _mm_mul_ps(radius, wy));
+            auto uy = _mm_add_ps(vy, _mm_mul_ps(radius, wx));
+            auto slip = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)));
+            auto sliding = _mm_cmpgt_ps(slip, epsilon);
+
+            auto limit = _mm_div_ps(slip, _mm_set1_ps(SLIDING_DECEL));
+            auto slideDone = _mm_and_ps(sliding, _mm_cmple_ps(limit, vdt));
+            auto tau = _mm_and_ps(sliding, _mm_min_ps(limit, vdt));
+            auto k = _mm_div_ps(_mm_set1_ps(-SLIDING_FRICTION * GRAVITY), _mm_max_ps(slip, epsilon));
+            auto ax = _mm_and_ps(sliding, _mm_mul_ps(ux, k));
+            auto ay = _mm_and_ps(sliding, _mm_mul_ps(uy, k));
+
+            auto tt = _mm_mul_ps(_mm_mul_ps(half, tau), tau);
+            px = _mm_add_ps(_mm_add_ps(px, _mm_mul_ps(vx, tau)), _mm_mul_ps(ax, tt));
+            py = _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(vy, tau)), _mm_mul_ps(ay, tt));
+            vx = _mm_add_ps(vx, _mm_mul_ps(ax, tau));
+            vy = _mm_add_ps(vy, _mm_mul_ps(ay, tau));
+            wx = _mm_add_ps(wx, _mm_mul_ps(_mm_mul_ps(alpha, ay), tau));
+            wy = _mm_sub_ps(wy, _mm_mul_ps(_mm_mul_ps(alpha, ax), tau));
+            wx = select(slideDone, _mm_div_ps(_mm_xor_ps(vy, signBit), radius), wx);
+            wy = select(slideDone, _mm_div_ps(vx, radius), wy);
+
+            auto rest = _mm_sub_ps(vdt, tau);
+            auto speed = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+            auto rolling = _mm_and_ps(_mm_or_ps(_mm_andnot_ps(sliding, allOnes), slideDone),
+                    _mm_cmpgt_ps(speed, epsilon));
+
+            auto limitR = _mm_div_ps(speed, _mm_set1_ps(ROLLING_DECEL));
+            auto rollDone = _mm_and_ps(rolling, _mm_cmple_ps(limitR, rest));
+            auto tauR = _mm_and_ps(rolling, _mm_min_ps(limitR, rest));
+            auto kR = _mm_div_ps(_mm_set1_ps(-ROLLING_DECEL), _mm_max_ps(speed, epsilon));
+            auto bx = _mm_and_ps(rolling, _mm_mul_ps(vx, kR));
+            auto by = _mm_and_ps(rolling, _mm_mul_ps(vy, kR));
+
+            auto ttR = _mm_mul_ps(_mm_mul_ps(half, tauR), tauR);
+            px = _mm_add_ps(_mm_add_ps(px, _mm_mul_ps(vx, tauR)), _mm_mul_ps(bx, ttR));
+            py = _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(vy, tauR)), _mm_mul_ps(by, ttR));
+            vx = _mm_add_ps(vx, _mm_mul_ps(bx, tauR));
+            vy = _mm_add_ps(vy, _mm_mul_ps(by, tauR));
+            wx = select(rolling, _mm_div_ps(_mm_xor_ps(vy, signBit), radius), wx);
+            wy = select(rolling, _mm_div_ps(vx, radius), wy);
+            vx = _mm_andnot_ps(rollDone, vx);
+            vy = _mm_andnot_ps(rollDone, vy);
+            wx = _mm_andnot_ps(rollDone, wx);
+            wy = _mm_andnot_ps(rollDone, wy);
+
+            auto stopped = _mm_cmple_ps(_mm_andnot_ps(signBit, wz), dw);
+            auto decayed = _mm_sub_ps(wz, _mm_or_ps(dw, _mm_and_ps(wz, signBit)));
+            wz = _mm_andnot_ps(stopped, decayed);
+
+            _mm_storeu_ps(b.posX + i, px);
+            _mm_storeu_ps(b.posY + i, py);
+            _mm_storeu_ps(b.velX + i, vx);
+            _mm_storeu_ps(b.velY + i, vy);
+            _mm_storeu_ps(b.angX + i, wx);
+            _mm_storeu_ps(b.angY + i, wy);
+            _mm_storeu_ps(b.angZ + i, wz);
+        }
+    }
+
+    int findContactsSse(const float *x, const float *y, int count, float minDist,
+            unsigned short *contacts) {
+        const auto min2 = _mm_set1_ps(minDist * minDist);
+        const auto valid = (1u << count) - 1;
+        int pairs = 0;
+        for (int i = 0; i < count; i++) {
+            auto xi = _mm_set1_ps(x[i]);
+            auto yi = _mm_set1_ps(y[i]);
+            unsigned int bits = 0;
+            for (int j = 0; j < count; j += 4) {
+                auto dx = _mm_sub_ps(_mm_loadu_ps(x + j), xi);
+                auto dy = _mm_sub_ps(_mm_loadu_ps(y + j), yi);
+                auto d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                bits |= static_cast<unsigned int>(_mm_movemask_ps(_mm_cmplt_ps(d2, min2))) << j;
+            }
+            // only pairs with j > i
+            bits &= valid & ~((2u << i) - 1);
+            contacts[i] = static_cast<unsigned short>(bits);
+            for (; bits; bits &= bits - 1) {
+                pairs++;
+            }
+        }
+        return pairs;
+    }
+}
+
+const Kernels &sseKernels() {
+    static const Kernels kernels = { "sse", integrateSse, findContactsSse };
+    return kernels;
+}
+
+}
+}
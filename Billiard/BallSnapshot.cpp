@@ -0,0 +1,39 @@
+#include "StdAfx.h"
+#include "BallSnapshot.h"
+
+#include <algorithm>
+
+namespace billiard {
+
+BallSnapshot::BallSnapshot() : count(0), moving(false), step(0), time(0) {
+    std::fill(posX, posX + BallSystem::MAX_BALLS, 0.0f);
+    std::fill(posY, posY + BallSystem::MAX_BALLS, 0.0f);
+}
+
+void BallSnapshot::capture(const BallSystem &balls, std::uint64_t step, double time) {
+    count = balls.count();
+    std::copy(balls.positionsX(), balls.positionsX() + BallSystem::MAX_BALLS, posX);
+    std::copy(balls.positionsY(), balls.positionsY() + BallSystem::MAX_BALLS, posY);
+    for (int i = 0; i < count; i++) {
+        orientation[i] = balls.orientation(i);
+    }
+    moving = balls.isMoving();
+    this->step = step;
+    this->time = time;
+}
+
+void BallSnapshot::interpolate(const BallSnapshot &a, const BallSnapshot &b, float alpha, BallSnapshot &out) {
+    out.count = b.count;
+    for (int i = 0; i < BallSystem::MAX_BALLS; i++) {
+        out.posX[i] = a.posX[i] + (b.posX[i] - a.posX[i]) * alpha;
+        out.posY[i] = a.posY[i] + (b.posY[i] - a.posY[i]) * alpha;
+    }
+    for (int i = 0; i < out.count; i++) {
+        out.orientation[i] = i < a.count ? glm::slerp(a.orientation[i], b.orientation[i], alpha) : b.orientation[i];
+    }
+    out.moving = b.moving;
+    out.step = b.step;
+    out.time = a.time + (b.time - a.time) * alpha;
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "BallSystem.h"
+
+namespace billiard {
+
+/**
+* What the renderer needs from BallSystem at one simulation step. Copied by
+* value between the simulation and render threads.
+*/
+struct BallSnapshot
+{
+    int count;
+    float posX[BallSystem::MAX_BALLS];
+    float posY[BallSystem::MAX_BALLS];
+    glm::quat orientation[BallSystem::MAX_BALLS];
+    bool moving;
+    std::uint64_t step;
+    double time; // seconds since start the state belongs to, on the wall clock
+
+    BallSnapshot();
+
+    void capture(const BallSystem &balls, std::uint64_t step, double time);
+
+    // positions are lerped and orientations slerped, alpha 0 gives a.
+    static void interpolate(const BallSnapshot &a, const BallSnapshot &b, float alpha, BallSnapshot &out);
+
+    glm::mat4 computeModelMat(int i) const {
+        return BallSystem::computeModelMat(glm::vec2(posX[i], posY[i]), orientation[i]);
+    }
+};
+
+}
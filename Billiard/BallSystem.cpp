@@ -0,0 +1,299 @@
+#include "StdAfx.h"
+#include "BallSystem.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "glm\gtc\matrix_transform.hpp"
+
+#include "BallKernels.h"
+#include "Physics.h"
+
+namespace billiard {
+
+using namespace physics;
+
+namespace {
+    // pushed apart pair by pair, a squeezed row of balls needs a few passes
+    // to settle, most steps need one or none
+    const int MAX_CONTACT_PASSES = 8;
+
+    float length(float x, float y) {
+        return std::sqrt(x * x + y * y);
+    }
+
+    void hashBytes(std::uint64_t &hash, const void *data, size_t size) {
+        auto bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+    }
+}
+
+BallSystem::BallSystem() : count_(0) {
+    // kernels process whole vectors, so the padding must hold sane values.
+    for (int i = 0; i < MAX_BALLS; i++) {
+        posX_[i] = posY_[i] = velX_[i] = velY_[i] = 0;
+        angX_[i] = angY_[i] = angZ_[i] = 0;
+        state_[i] = State::Stationary;
+    }
+}
+
+kernels::BallArrays BallSystem::arrays() {
+    kernels::BallArrays result = { posX_, posY_, velX_, velY_, angX_, angY_, angZ_, count_ };
+    return result;
+}
+
+void BallSystem::rack() {
+    count_ = MAX_BALLS;
+    for (int i = 0; i < count_; i++) {
+        velX_[i] = velY_[i] = 0;
+        angX_[i] = angY_[i] = angZ_[i] = 0;
+        orientation_[i] = glm::quat();
+        state_[i] = State::Stationary;
+    }
+
+    place(0, glm::vec2(0, -TABLE_HEIGHT / 4));
+
+    // small gap, so object balls do not touch each other at rest.
+    const float spacing = BALL_DIAMETER * 1.001f;
+    const glm::vec2 apex(0, TABLE_HEIGHT / 8);
+
+    int i = 1;
+    for (int row = 0; row < 5; row++) {
+        for (int k = 0; k <= row; k++) {
+            place(i++, apex + glm::vec2((k - row * 0.5f) * spacing,
+                                         row * spacing * std::sqrt(3.0f) / 2));
+        }
+    }
+}
+
+void BallSystem::place(int i, const glm::vec2 &position) {
+    posX_[i] = position.x;
+    posY_[i] = position.y;
+}
+
+void BallSystem::strike(int i, const glm::vec2 &velocity, const glm::vec3 &angular) {
+    velX_[i] = velocity.x;
+    velY_[i] = velocity.y;
+    angX_[i] = angular.x;
+    angY_[i] = angular.y;
+    angZ_[i] = angular.z;
+    updateState(i);
+}
+
+void BallSystem::updateState(int i) {
+    auto speed = length(velX_[i], velY_[i]);
+
+    // velocity of the contact point: v + w x (-R * k)
+    auto ux = velX_[i] - RADIUS * angY_[i];
+    auto uy = velY_[i] + RADIUS * angX_[i];
+
+    if (length(ux, uy) > EPSILON) {
+        state_[i] = State::Sliding;
+    } else if (speed > EPSILON) {
+        state_[i] = State::Rolling;
+    } else if (std::fabs(angZ_[i]) > EPSILON) {
+        state_[i] = State::Spinning;
+    } else {
+        state_[i] = State::Stationary;
+    }
+}
+
+bool BallSystem::isMoving() const {
+    for (int i = 0; i < count_; i++) {
+        if (state_[i] != State::Stationary) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BallSystem::rotate(int i, const glm::vec3 &angular, float dt) {
+    auto w = glm::length(angular);
+    if (w * dt < 1e-7f) {
+        return;
+    }
+    auto axis = angular / w;
+    auto halfAngle = w * dt / 2;
+    auto s = std::sin(halfAngle);
+    glm::quat q(std::cos(halfAngle), axis.x * s, axis.y * s, axis.z * s);
+    orientation_[i] = glm::normalize(q * orientation_[i]);
+}
+
+glm::vec2 BallSystem::acceleration(int i) const {
+    switch (state_[i]) {
+    case State::Rolling: {
+        auto speed = length(velX_[i], velY_[i]);
+        return -ROLLING_FRICTION * GRAVITY * glm::vec2(velX_[i], velY_[i]) / speed;
+    }
+    case State::Sliding: {
+        auto ux = velX_[i] - RADIUS * angY_[i];
+        auto uy = velY_[i] + RADIUS * angX_[i];
+        return -SLIDING_FRICTION * GRAVITY * glm::vec2(ux, uy) / length(ux, uy);
+    }
+    default:
+        return glm::vec2(0);
+    }
+}
+
+float BallSystem::timeToTransition(int i) const {
+    switch (state_[i]) {
+    case State::Spinning:
+        return std::fabs(angZ_[i]) / SPIN_DECEL;
+    case State::Rolling:
+        return length(velX_[i], velY_[i]) / ROLLING_DECEL;
+    case State::Sliding: {
+        auto ux = velX_[i] - RADIUS * angY_[i];
+        auto uy = velY_[i] + RADIUS * angX_[i];
+        return length(ux, uy) / SLIDING_DECEL;
+    }
+    default:
+        return std::numeric_limits<float>::infinity();
+    }
+}
+
+/*
+    Motion within one state has constant acceleration, so the kernels
+    integrate it exactly, splitting dt at the moments balls change state.
+*/
+void BallSystem::advance(float dt) {
+    glm::vec3 w0[MAX_BALLS];
+    for (int i = 0; i < count_; i++) {
+        w0[i] = angularVelocity(i);
+    }
+
+    kernels::activeKernels().integrate(arrays(), dt);
+
+    for (int i = 0; i < count_; i++) {
+        if (state_[i] != State::Stationary) {
+            rotate(i, (w0[i] + angularVelocity(i)) * 0.5f, dt);
+            updateState(i);
+        }
+    }
+}
+
+void BallSystem::collide(int i, int j) {
+    auto dx = posX_[j] - posX_[i];
+    auto dy = posY_[j] - posY_[i];
+    auto dist = length(dx, dy);
+    if (dist < EPSILON) {
+        return;
+    }
+    auto nx = dx / dist;
+    auto ny = dy / dist;
+
+    auto approach = (velX_[i] - velX_[j]) * nx + (velY_[i] - velY_[j]) * ny;
+    if (approach <= 0) {
+        return;
+    }
+
+    // equal masses, no friction between balls
+    auto impulse = approach * (1 + BALL_RESTITUTION) / 2;
+    velX_[i] -= impulse * nx;
+    velY_[i] -= impulse * ny;
+    velX_[j] += impulse * nx;
+    velY_[j] += impulse * ny;
+    updateState(i);
+    updateState(j);
+}
+
+void BallSystem::collideCushion(int i, int axis) {
+    auto &vel = axis == 0 ? velX_[i] : velY_[i];
+    vel = -vel * CUSHION_RESTITUTION;
+    updateState(i);
+}
+
+void BallSystem::resolveContacts() {
+    const float limitX = cushionLimit(0);
+    const float limitY = cushionLimit(1);
+
+    // pushing a pair apart can push one of them into a third ball, so the
+    // contacts are found again after each pass while balls still move apart
+    unsigned short contacts[MAX_BALLS];
+    for (int pass = 0; pass < MAX_CONTACT_PASSES; pass++) {
+        if (kernels::activeKernels().findContacts(posX_, posY_, count_, BALL_DIAMETER, contacts) == 0) {
+            break;
+        }
+
+        auto separated = false;
+        for (int i = 0; i < count_; i++) {
+            for (unsigned int bits = contacts[i]; bits; bits &= bits - 1) {
+                int j = 0;
+                while (!(bits & (1u << j))) {
+                    j++;
+                }
+
+                auto dx = posX_[j] - posX_[i];
+                auto dy = posY_[j] - posY_[i];
+                auto dist = length(dx, dy);
+                if (dist >= BALL_DIAMETER || dist < EPSILON) {
+                    continue;
+                }
+
+                // push balls apart evenly
+                auto overlap = (BALL_DIAMETER - dist) / 2;
+                posX_[i] -= dx / dist * overlap;
+                posY_[i] -= dy / dist * overlap;
+                posX_[j] += dx / dist * overlap;
+                posY_[j] += dy / dist * overlap;
+                collide(i, j);
+                separated = true;
+            }
+        }
+        if (!separated) {
+            break;
+        }
+    }
+
+    for (int i = 0; i < count_; i++) {
+        if (std::fabs(posX_[i]) > limitX && posX_[i] * velX_[i] > 0) {
+            posX_[i] = posX_[i] > 0 ? limitX : -limitX;
+            collideCushion(i, 0);
+        }
+        if (std::fabs(posY_[i]) > limitY && posY_[i] * velY_[i] > 0) {
+            posY_[i] = posY_[i] > 0 ? limitY : -limitY;
+            collideCushion(i, 1);
+        }
+    }
+}
+
+float BallSystem::cushionLimit(int axis) {
+    return (axis == 0 ? TABLE_WIDTH : TABLE_HEIGHT) / 2 - RADIUS;
+}
+
+void BallSystem::step(float dt) {
+    advance(dt);
+    resolveContacts();
+}
+
+glm::mat4 BallSystem::computeModelMat(int i) const {
+    return computeModelMat(position(i), orientation_[i]);
+}
+
+glm::mat4 BallSystem::computeModelMat(const glm::vec2 &position, const glm::quat &orientation) {
+    glm::mat4 modelMat;
+    modelMat = glm::translate(modelMat, glm::vec3(position, RADIUS));
+    modelMat = modelMat * glm::mat4_cast(orientation);
+    modelMat = glm::scale(modelMat, glm::vec3(RADIUS));
+    return modelMat;
+}
+
+std::uint64_t BallSystem::hash() const {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    auto size = count_ * sizeof(float);
+    hashBytes(hash, &count_, sizeof(count_));
+    hashBytes(hash, posX_, size);
+    hashBytes(hash, posY_, size);
+    hashBytes(hash, velX_, size);
+    hashBytes(hash, velY_, size);
+    hashBytes(hash, angX_, size);
+    hashBytes(hash, angY_, size);
+    hashBytes(hash, angZ_, size);
+    hashBytes(hash, orientation_, count_ * sizeof(glm::quat));
+    hashBytes(hash, state_, count_ * sizeof(State));
+    return hash;
+}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+#include <glm\glm.hpp>
+#include <glm\gtc\quaternion.hpp>
+
+#include "BallKernels.h"
+#include "Dimensions.h"
+
+namespace billiard {
+
+/**
+* Simulation state of all balls on the table, stored as structure of arrays.
+* Does not touch GL, so it can be stepped without any window or context.
+*/
+class BallSystem
+{
+public:
+    static const int MAX_BALLS = 16;
+
+    enum class State : unsigned char {
+        Stationary,
+        Spinning, // no translation, only spinning around z axis
+        Rolling,
+        Sliding
+    };
+
+private:
+    int count_;
+
+    float posX_[MAX_BALLS];
+    float posY_[MAX_BALLS];
+    float velX_[MAX_BALLS];
+    float velY_[MAX_BALLS];
+    float angX_[MAX_BALLS];
+    float angY_[MAX_BALLS];
+    float angZ_[MAX_BALLS];
+
+    glm::quat orientation_[MAX_BALLS];
+    State state_[MAX_BALLS];
+
+    kernels::BallArrays arrays();
+    void rotate(int i, const glm::vec3 &angular, float dt);
+    void resolveContacts();
+
+public:
+    BallSystem();
+
+    // places cue ball and 15 object balls in a triangle.
+    void rack();
+    void place(int i, const glm::vec2 &position);
+    void strike(int i, const glm::vec2 &velocity, const glm::vec3 &angular);
+
+    // fixed step: moves balls and resolves overlapping contacts.
+    void step(float dt);
+
+    // moves balls under friction only, ignores collisions.
+    void advance(float dt);
+
+    // motion until the next state transition is p + v * t + a * t^2 / 2
+    glm::vec2 acceleration(int i) const;
+    float timeToTransition(int i) const;
+
+    // collision responses, both keep positions untouched.
+    void collide(int i, int j);
+    void collideCushion(int i, int axis);
+
+    // max |x| (axis 0) or |y| (axis 1) of a ball center.
+    static float cushionLimit(int axis);
+
+    void updateState(int i);
+    bool isMoving() const;
+
+    int count() const { return count_; }
+    State state(int i) const { return state_[i]; }
+    glm::vec2 position(int i) const { return glm::vec2(posX_[i], posY_[i]); }
+
+    // zero padded up to MAX_BALLS, for SIMD readers.
+    const float *positionsX() const { return posX_; }
+    const float *positionsY() const { return posY_; }
+    glm::vec2 velocity(int i) const { return glm::vec2(velX_[i], velY_[i]); }
+    glm::vec3 angularVelocity(int i) const { return glm::vec3(angX_[i], angY_[i], angZ_[i]); }
+    const glm::quat &orientation(int i) const { return orientation_[i]; }
+
+    glm::mat4 computeModelMat(int i) const;
+    static glm::mat4 computeModelMat(const glm::vec2 &position, const glm::quat &orientation);
+
+    // FNV-1a of the exact bits of the state, equal hashes mean equal states.
+    std::uint64_t hash() const;
+};
+
+}
@@ -8,10 +8,26 @@
 #include <GL/glew.h>
 #include <GL/GL.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <memory>
-
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "BallKernels.h"
+#include "Bundle.h"
 #include "Game.h"
+#include "HeadlessContext.h"
+#include "ProgramCache.h"
+#include "SelfTest.h"
+#include "ShotEvaluator.h"
+#include "StateTrace.h"
+#include "utils.h"
 
 #ifdef _DEBUG
     #include <crtdbg.h>
@@ -64,6 +80,353 @@ namespace {
     void window_size_callback(GLFWwindow* window, int w, int h) {
         g->resize(w, h);
     }
+
+    // simulates a fan of break shots without creating a window.
+    int evaluateShots(int count) {
+        billiard::BallSystem table;
+        table.rack();
+
+        std::vector<billiard::Shot> shots;
+        for (int i = 0; i < count; i++) {
+            auto angle = static_cast<float>(M_PI) * (static_cast<float>(i) / count - 0.5f) / 4;
+            billiard::Shot shot = { 0, glm::vec2(std::sin(angle), std::cos(angle)) * 40.0f, glm::vec3(0) };
+            shots.push_back(shot);
+        }
+
+        billiard::ShotEvaluator evaluator;
+        auto start = std::chrono::high_resolution_clock::now();
+        auto results = evaluator.evaluate(table, shots);
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << results.size() << " shots in " << elapsed.count() << " s, "
+                  << results.size() / elapsed.count() << " shots/s" << std::endl;
+        return 0;
+    }
+
+    // loads GL entry points and checks the version of the current context.
+    bool initGl() {
+        glewExperimental = GL_TRUE;
+
+        auto err = glewInit();
+        if (GLEW_OK != err) {
+            LOG(ERROR) << "glewInit failed.";
+            LOG(ERROR) << "Error: " << glewGetErrorString(err);
+            return false;
+        }
+
+        if (!GLEW_VERSION_4_1) {
+            LOG(ERROR) << "OpenGL 4.1 not supported.\n";
+            return false;
+        }
+
+        GLint majorVersion;
+        GLint minorVersion;
+        glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+        glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+        if (majorVersion < 4) {
+            LOG(ERROR) << "OpenGL major version is " << majorVersion;
+            return false;
+        }
+        if (minorVersion < 1) {
+            LOG(ERROR) << "OpenGL minor version is " << minorVersion;
+            return false;
+        }
+        return true;
+    }
+
+    // program binaries are kept next to the assets between runs, unless disabled.
+    std::unique_ptr<glsl::ProgramCache> createProgramCache(bool enabled) {
+        std::unique_ptr<glsl::ProgramCache> cache;
+        if (enabled) {
+            cache.reset(new glsl::ProgramCache(utils::getExePath() + "../cache/"));
+        }
+        glsl::Program::setCache(cache.get());
+        return cache;
+    }
+
+    // after the first frame, when every program has been used and so checked.
+    void logCompileStats(const glsl::ProgramCache *cache) {
+        auto stats = glsl::Program::getCompileStats();
+        LOG(INFO) << stats.programs << " programs ready " << stats.wallMs << " ms after the first was submitted, "
+            << stats.submitMs << " ms submitting, " << stats.waitMs << " ms waiting";
+        if (cache && cache->isSupported()) {
+            LOG(INFO) << "Program cache: " << cache->getHits() << " hits, " << cache->getMisses() 
+                << " misses, " << cache->getRejected() << " rejected";
+        }
+    }
+
+    // a fixed break stepped like the game does, hashing every step.
+    billiard::StateTrace replayBreak() {
+        const float step = 1.0f / 60;
+        const int maxSteps = 60 * 60;
+
+        billiard::BallSystem table;
+        table.rack();
+        table.strike(0, glm::vec2(0.02f, 1) * 40.0f, glm::vec3(0));
+
+        billiard::EventSolver solver;
+        billiard::StateTrace trace;
+        trace.record(table);
+        for (int i = 0; i < maxSteps && table.isMoving(); i++) {
+            solver.advance(table, step);
+            trace.record(table);
+        }
+        return trace;
+    }
+
+    int recordTrace(const char *filename) {
+        auto trace = replayBreak();
+        trace.save(filename);
+        std::cout << trace.size() << " steps recorded" << std::endl;
+        return 0;
+    }
+
+    int verifyTrace(const char *filename) {
+        auto expected = billiard::StateTrace::load(filename);
+        auto actual = replayBreak();
+
+        auto step = billiard::StateTrace::findDivergence(expected, actual);
+        if (step < 0) {
+            std::cout << "identical, " << actual.size() << " steps" << std::endl;
+            return 0;
+        }
+        std::cout << "diverged at step " << step << std::hex;
+        if (step < expected.size() && step < actual.size()) {
+            std::cout << ": expected " << expected.at(step) << ", got " << actual.at(step);
+        } else {
+            std::cout << std::dec << ": " << expected.size() << " steps expected, got " << actual.size();
+        }
+        std::cout << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool hasFlag(int argc, _TCHAR* argv[], const char *flag) {
+        for (int i = 1; i < argc; i++) {
+            if (std::strcmp(argv[i], flag) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // value following the flag, or fallback when the flag is not given.
+    const char *getOption(int argc, _TCHAR* argv[], const char *flag, const char *fallback) {
+        for (int i = 1; i + 1 < argc; i++) {
+            if (std::strcmp(argv[i], flag) == 0) {
+                return argv[i + 1];
+            }
+        }
+        return fallback;
+    }
+
+    // light shaft settings shared by the windowed and the offscreen runs.
+    struct ShaftOptions {
+        int slices;
+        int divisor;
+        bool adaptiveSlices;
+        bool rayMarch;
+        int marchSteps;
+        bool temporal;
+    };
+
+    // false on values Game would reject, before any window or context is made.
+    bool parseShaftOptions(int argc, _TCHAR* argv[], ShaftOptions *options) {
+        options->slices = std::atoi(getOption(argc, argv, "--shaft-slices", "32"));
+        options->divisor = std::atoi(getOption(argc, argv, "--shaft-divisor", "1"));
+        options->adaptiveSlices = !hasFlag(argc, argv, "--fixed-shaft-slices");
+        options->rayMarch = hasFlag(argc, argv, "--ray-march-shafts");
+        options->marchSteps = std::atoi(getOption(argc, argv, "--march-steps", "32"));
+        options->temporal = hasFlag(argc, argv, "--temporal-shafts");
+
+        if (options->slices < 2) {
+            LOG(ERROR) << "--shaft-slices must be 2 or more";
+            return false;
+        }
+        if (options->divisor != 1 && options->divisor != 2 && options->divisor != 4) {
+            LOG(ERROR) << "--shaft-divisor must be 1, 2 or 4";
+            return false;
+        }
+        if (options->marchSteps < 1) {
+            LOG(ERROR) << "--march-steps must be 1 or more";
+            return false;
+        }
+        return true;
+    }
+
+    void applyShaftOptions(billiard::Game &game, const ShaftOptions &options) {
+        game.setLightshaftQuality(options.slices, options.divisor);
+        game.setAdaptiveShaftSlices(options.adaptiveSlices);
+        game.setShaftTechnique(options.rayMarch ? billiard::ShaftTechnique::RayMarch : billiard::ShaftTechnique::Slices,
+                               options.marchSteps, options.temporal);
+    }
+
+    // a GL context without a window, nullptr when there is none or it is too old.
+    std::unique_ptr<billiard::HeadlessContext> createHeadlessContext(int width, int height) {
+        std::unique_ptr<billiard::HeadlessContext> context;
+        try {
+            context.reset(new billiard::HeadlessContext(width, height));
+        } catch (const std::exception &e) {
+            LOG(ERROR) << e.what();
+            return nullptr;
+        }
+        if (!initGl()) {
+            return nullptr;
+        }
+        // glewInit leaves GL_INVALID_ENUM behind on core profiles
+        glGetError();
+        return context;
+    }
+
+    // color and depth the game renders into instead of a window.
+    struct OffscreenTarget {
+        billiard::Renderbuffer color;
+        billiard::Renderbuffer depth;
+        billiard::Framebuffer framebuffer;
+        bool complete;
+        const int width;
+        const int height;
+        std::vector<unsigned char> pixels;
+
+        OffscreenTarget(int width, int height) : width(width), height(height), pixels(width * height * 4) {
+            glBindRenderbuffer(GL_RENDERBUFFER, color);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, depth);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+            framebuffer.bind<GL_FRAMEBUFFER>();
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+            complete = billiard::isFramebufferOk(glCheckFramebufferStatus(GL_FRAMEBUFFER));
+            billiard::Framebuffer::unbind<GL_FRAMEBUFFER>();
+        }
+
+        bool savePng(const std::string &filename) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, pixels.data());
+            return utils::savePng(filename.c_str(), width, height, pixels.data());
+        }
+    };
+
+    // renders a break into an offscreen framebuffer, one png per frame.
+    // maxFps > 0 sleeps between frames, so a long run does not take a whole core.
+    int renderHeadless(int frames, int width, int height, const std::string &outDir,
+            const char *traceFile, double maxFps, bool programCache, bool depthPrepass,
+            const ShaftOptions &shafts) {
+        auto context = createHeadlessContext(width, height);
+        if (!context) {
+            return EXIT_FAILURE;
+        }
+        OffscreenTarget target(width, height);
+        if (!target.complete) {
+            return EXIT_FAILURE;
+        }
+
+        auto cache = createProgramCache(programCache);
+        billiard::Game game(width, height);
+        game.setTargetFramebuffer(target.framebuffer);
+        game.setFixedTimestep(true);
+        game.setDepthPrepass(depthPrepass);
+        applyShaftOptions(game, shafts);
+        game.keyAction(GLFW_KEY_SPACE, true);
+
+        billiard::FrameLimiter limiter(maxFps);
+        for (int i = 0; i < frames; i++) {
+            limiter.wait();
+            game.render();
+            if (i == 0) {
+                logCompileStats(cache.get());
+            }
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame%04d.png", i);
+            if (!target.savePng(outDir + name)) {
+                return EXIT_FAILURE;
+            }
+        }
+
+        std::cout << frames << " frames rendered with " << billiard::HeadlessContext::getBackendName()
+                  << " into " << outDir << std::endl;
+
+        if (traceFile) {
+            auto &profiler = game.getProfiler();
+            profiler.flush();
+            profiler.report(std::cout);
+            profiler.dumpTrace(traceFile);
+        }
+        return 0;
+    }
+    /*
+        The light shaft techniques one after another on the same racked
+        table, each for the profiler's window of frames after a short warm
+        up, reporting the GPU time of the shaft pass (CPU time without timer
+        queries). With an output directory the last frame of each is saved
+        next to the others.
+    */
+    int benchShafts(int width, int height, const std::string &outDir, bool programCache, const ShaftOptions &base) {
+        auto context = createHeadlessContext(width, height);
+        if (!context) {
+            return EXIT_FAILURE;
+        }
+        OffscreenTarget target(width, height);
+        if (!target.complete) {
+            return EXIT_FAILURE;
+        }
+
+        auto cache = createProgramCache(programCache);
+        billiard::Game game(width, height);
+        game.setTargetFramebuffer(target.framebuffer);
+        game.setFixedTimestep(true);
+
+        struct Run {
+            const char *name;
+            bool rayMarch;
+            bool adaptiveSlices;
+            bool temporal;
+        };
+        const Run runs[] = {
+            { "slices", false, false, false },
+            { "adaptive slices", false, true, false },
+            { "ray march", true, false, false },
+            { "ray march temporal", true, false, true },
+        };
+        const int warmUp = billiard::Profiler::FRAME_LATENCY * 4;
+
+        auto &profiler = game.getProfiler();
+        auto gpu = profiler.hasGpuTiming();
+        std::cout << "light shafts at " << width << "x" << height << ", 1/" << base.divisor << " resolution, "
+                  << base.slices << " slices, " << base.marchSteps << " march steps, "
+                  << (gpu ? "gpu" : "cpu") << " ms over " << billiard::Profiler::WINDOW << " frames" << std::endl;
+        for (const auto &run : runs) {
+            auto options = base;
+            options.rayMarch = run.rayMarch;
+            options.adaptiveSlices = run.adaptiveSlices;
+            options.temporal = run.temporal;
+            applyShaftOptions(game, options);
+
+            // the statistics roll over the window, nothing of the previous run is left
+            for (int i = 0; i < warmUp + billiard::Profiler::WINDOW; i++) {
+                game.render();
+            }
+            profiler.flush();
+
+            auto shaft = profiler.getPassStats("lightshaft", gpu);
+            auto frame = profiler.getPassStats("frame", gpu);
+            std::cout << std::fixed << std::setprecision(3) << run.name << ": shafts " << shaft.average
+                      << " ms (max " << shaft.max << "), frame " << frame.average << " ms" << std::endl;
+
+            if (!outDir.empty()) {
+                std::string name = run.name;
+                std::replace(name.begin(), name.end(), ' ', '-');
+                if (!target.savePng(outDir + "shafts-" + name + ".png")) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        return 0;
+    }
 }
 
 int run(int argc, _TCHAR* argv[]) 
@@ -72,6 +435,61 @@ int run(int argc, _TCHAR* argv[])
     InitGoogleLogging(argv[0]);
     LOG(INFO) << "starting";
 
+    billiard::kernels::setDeterministic(hasFlag(argc, argv, "--deterministic"));
+
+    ShaftOptions shafts;
+    if (!parseShaftOptions(argc, argv, &shafts)) {
+        return EXIT_FAILURE;
+    }
+
+    if (argc > 2 && std::strcmp(argv[1], "--record-trace") == 0) {
+        billiard::kernels::setDeterministic(true);
+        return recordTrace(argv[2]);
+    }
+    if (argc > 2 && std::strcmp(argv[1], "--verify-trace") == 0) {
+        billiard::kernels::setDeterministic(true);
+        return verifyTrace(argv[2]);
+    }
+    if (hasFlag(argc, argv, "--headless") || hasFlag(argc, argv, "--bench-shafts")) {
+        int width = 640;
+        int height = 480;
+        std::sscanf(getOption(argc, argv, "--size", "640x480"), "%dx%d", &width, &height);
+        std::string outDir = getOption(argc, argv, "--out", "");
+        if (!outDir.empty() && outDir.back() != '/' && outDir.back() != '\\') {
+            outDir += '/';
+        }
+        if (hasFlag(argc, argv, "--bench-shafts")) {
+            return benchShafts(width, height, outDir, !hasFlag(argc, argv, "--no-program-cache"), shafts);
+        }
+        return renderHeadless(std::atoi(getOption(argc, argv, "--frames", "1")), width, height, outDir,
+                              getOption(argc, argv, "--trace", nullptr),
+                              std::atof(getOption(argc, argv, "--max-fps", "0")),
+                              !hasFlag(argc, argv, "--no-program-cache"),
+                              hasFlag(argc, argv, "--depth-prepass"),
+                              shafts);
+    }
+    if (argc > 2 && std::strcmp(argv[1], "--evaluate-shots") == 0) {
+        return evaluateShots(std::atoi(argv[2]));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--pack-assets") == 0) {
+        // textures decoded ahead of time, loaded by Game instead of loose files
+        auto exePath = utils::getExePath();
+        std::string out = getOption(argc, argv, "--out", (exePath + "../assets.bundle").c_str());
+        std::vector<std::string> directories;
+        directories.push_back("shaders");
+        directories.push_back("textures");
+        billiard::Bundle::pack(exePath + "../assets/", directories, out, hasFlag(argc, argv, "--mips"));
+        std::cout << "packed " << out << std::endl;
+        return 0;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-kernels") == 0) {
+        billiard::kernels::runBenchmark(std::cout);
+        return 0;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--self-test") == 0) {
+        return billiard::runSelfTests() == 0 ? 0 : EXIT_FAILURE;
+    }
+
     glfwSetErrorCallback(error_callback);
     if (!glfwInit()) {
         return EXIT_FAILURE;
@@ -89,30 +507,7 @@ int run(int argc, _TCHAR* argv[])
     glfwMakeContextCurrent(window);
     glfwSetKeyCallback(window, key_callback);
 
-    glewExperimental = GL_TRUE;
-
-    auto err = glewInit();
-    if (GLEW_OK != err) {
-        LOG(ERROR) << "glewInit failed.";
-        LOG(ERROR) << "Error: " << glewGetErrorString(err);
-        return EXIT_FAILURE;
-    }
-
-    if (!GLEW_VERSION_4_1) {
-        LOG(ERROR) << "OpenGL 4.1 not supported.\n";
-        return EXIT_FAILURE;
-    }
-
-    GLint majorVersion;
-    GLint minorVersion;
-    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
-    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
-    if (majorVersion < 4) {
-        LOG(ERROR) << "OpenGL major version is " << majorVersion;
-        return EXIT_FAILURE;
-    }
-    if (minorVersion < 1) {
-        LOG(ERROR) << "OpenGL minor version is " << minorVersion;
+    if (!initGl()) {
         return EXIT_FAILURE;
     }
 
@@ -124,20 +519,41 @@ int run(int argc, _TCHAR* argv[])
         LOG(INFO) << "ogl error on initialization: " << err;
     }
 
+    auto cache = createProgramCache(!hasFlag(argc, argv, "--no-program-cache"));
     g = std::make_shared<billiard::Game>(width, height);
+    g->setDepthPrepass(hasFlag(argc, argv, "--depth-prepass"));
+    applyShaftOptions(*g, shafts);
+    g->startSimulationThread();
+    if (hasFlag(argc, argv, "--hot-reload")) {
+        g->enableShaderReload();
+    }
+
+    billiard::FrameLimiter limiter(std::atof(getOption(argc, argv, "--max-fps", "0")));
 
     glfwSetCursorPosCallback(window, mouse_move_callback);
     glfwSetMouseButtonCallback(window, mouse_callback);
     glfwSetScrollCallback(window, mouse_scroll_callback);
     glfwSetWindowSizeCallback(window, window_size_callback);
     
-    while (!glfwWindowShouldClose(window)) {
-        g->render();
+    auto result = 0;
+    for (auto frame = 0; !glfwWindowShouldClose(window); frame++) {
+        try {
+            g->render();
+        } catch (const std::exception &e) {
+            LOG(ERROR) << e.what();
+            result = EXIT_FAILURE;
+            break;
+        }
+        if (frame == 0) {
+            logCompileStats(cache.get());
+        }
         glfwSwapBuffers(window);
         glfwPollEvents();
+        limiter.wait();
     }
 
     g.reset();
+    glsl::Program::setCache(nullptr);
 
     glfwDestroyWindow(window);
     glfwTerminate();
@@ -145,7 +561,7 @@ int run(int argc, _TCHAR* argv[])
     LOG(INFO) << "done.";
     ShutdownGoogleLogging();
 
-    return 0;
+    return result;
 }
 
 int _tmain(int argc, _TCHAR* argv[]) 
@@ -0,0 +1,259 @@
+#include "StdAfx.h"
+#include "Bundle.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "glog\logging.h"
+
+#include "utils.h"
+
+namespace billiard {
+
+const char Bundle::MAGIC[8] = { 'B', 'I', 'L', 'L', 'P', 'A', 'C', 'K' };
+
+namespace {
+    const size_t ALIGNMENT = 16;
+
+    bool endsWith(const std::string &s, const char *suffix) {
+        auto length = std::strlen(suffix);
+        return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+    }
+
+    // regular files of a directory, sorted so bundles come out the same every time.
+    std::vector<std::string> listFiles(const std::string &directory) {
+        std::vector<std::string> files;
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        auto find = FindFirstFileA((directory + "/*").c_str(), &data);
+        if (find == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot list " + directory);
+        }
+        do {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+                files.push_back(data.cFileName);
+            }
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+#else
+        auto dir = opendir(directory.c_str());
+        if (!dir) {
+            throw std::runtime_error("Cannot list " + directory);
+        }
+        while (auto entry = readdir(dir)) {
+            struct stat st;
+            if (stat((directory + "/" + entry->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                files.push_back(entry->d_name);
+            }
+        }
+        closedir(dir);
+#endif
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    void pad(std::ofstream &out) {
+        static const char zeros[ALIGNMENT] = {};
+        auto position = static_cast<size_t>(out.tellp());
+        out.write(zeros, (ALIGNMENT - position % ALIGNMENT) % ALIGNMENT);
+    }
+}
+
+Bundle::Bundle(const std::string &filename) : data_(nullptr), size_(0) {
+#ifdef _WIN32
+    file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    mapping_ = nullptr;
+    if (file_ == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot open bundle " + filename);
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<size_t>(size.QuadPart);
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) {
+        data_ = static_cast<const unsigned char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    file_ = open(filename.c_str(), O_RDONLY);
+    if (file_ < 0) {
+        throw std::runtime_error("Cannot open bundle " + filename);
+    }
+    struct stat st;
+    fstat(file_, &st);
+    size_ = static_cast<size_t>(st.st_size);
+    auto data = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0) : MAP_FAILED;
+    if (data != MAP_FAILED) {
+        data_ = static_cast<const unsigned char *>(data);
+        madvise(data, size_, MADV_SEQUENTIAL);
+    }
+#endif
+    if (!data_) {
+        unmap();
+        throw std::runtime_error("Cannot map bundle " + filename);
+    }
+
+    // the table is at the end, everything before it is checked against the size
+    Header header;
+    if (size_ < sizeof(header)) {
+        unmap();
+        throw std::runtime_error(filename + " is not a bundle");
+    }
+    std::memcpy(&header, data_, sizeof(header));
+
+    // sizes are compared against what is left, sums of damaged values could wrap
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+            || header.entriesOffset % ALIGNMENT != 0 || header.entriesOffset > size_
+            || header.entryCount > (size_ - header.entriesOffset) / sizeof(Entry)) {
+        unmap();
+        throw std::runtime_error(filename + " is not a bundle of version " + std::to_string(VERSION));
+    }
+
+    auto tableEnd = header.entriesOffset + header.entryCount * sizeof(Entry);
+    auto entries = reinterpret_cast<const Entry *>(data_ + header.entriesOffset);
+    auto names = reinterpret_cast<const char *>(data_ + tableEnd);
+    for (std::uint32_t i = 0; i < header.entryCount; i++) {
+        const auto &entry = entries[i];
+        if (entry.offset > header.entriesOffset || entry.size > header.entriesOffset - entry.offset
+                || entry.nameOffset > size_ - tableEnd || entry.nameLength > size_ - tableEnd - entry.nameOffset) {
+            unmap();
+            throw std::runtime_error(filename + " is damaged");
+        }
+        entries_[std::string(names + entry.nameOffset, entry.nameLength)] = &entry;
+    }
+
+#ifdef _WIN32
+    // faults the whole file in with one front to back pass
+    volatile unsigned char sink = 0;
+    for (size_t offset = 0; offset < size_; offset += 4096) {
+        sink += data_[offset];
+    }
+#else
+    madvise(const_cast<unsigned char *>(data_), size_, MADV_WILLNEED);
+#endif
+}
+
+Bundle::~Bundle() {
+    unmap();
+}
+
+void Bundle::unmap() {
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+        CloseHandle(file_);
+    }
+#else
+    if (data_) {
+        munmap(const_cast<unsigned char *>(data_), size_);
+    }
+    if (file_ >= 0) {
+        close(file_);
+    }
+#endif
+}
+
+const Bundle::Entry *Bundle::find(const std::string &name) const {
+    auto it = entries_.find(name);
+    return it != entries_.end() ? it->second : nullptr;
+}
+
+const char *Bundle::text(const Entry &entry) const {
+    return reinterpret_cast<const char *>(data_ + entry.offset);
+}
+
+image::Pixels Bundle::image(const Entry &entry) const {
+    image::Pixels pixels;
+    pixels.info.width = entry.width;
+    pixels.info.height = entry.height;
+    pixels.info.channels = entry.channels;
+    pixels.info.levels = entry.levels;
+    pixels.mapped = data_ + entry.offset;
+    if (pixels.info.size() != entry.size) {
+        throw std::runtime_error("Bundled image has a wrong size");
+    }
+    return pixels;
+}
+
+void Bundle::pack(const std::string &root, const std::vector<std::string> &directories,
+        const std::string &filename, bool mips) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Cannot write bundle " + filename);
+    }
+
+    Header header = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<Entry> entries;
+    std::string names;
+    for (const auto &directory : directories) {
+        for (const auto &file : listFiles(root + directory)) {
+            auto name = directory + "/" + file;
+            auto path = root + name;
+            pad(out);
+
+            Entry entry = {};
+            entry.offset = static_cast<std::uint64_t>(out.tellp());
+            entry.nameOffset = static_cast<std::uint32_t>(names.size());
+            entry.nameLength = static_cast<std::uint32_t>(name.size());
+            if (endsWith(file, ".png")) {
+                auto pixels = image::load(path.c_str());
+                if (mips) {
+                    image::generateMips(pixels);
+                }
+                entry.type = IMAGE;
+                entry.width = pixels.info.width;
+                entry.height = pixels.info.height;
+                entry.channels = pixels.info.channels;
+                entry.levels = pixels.info.levels;
+                entry.size = pixels.data.size();
+                out.write(reinterpret_cast<const char *>(pixels.data.data()), pixels.data.size());
+            } else {
+                auto data = utils::loadAsset(path);
+                entry.type = TEXT;
+                entry.size = data.size();
+                out.write(data.data(), data.size());
+            }
+            // text gets a terminating zero outside its size, so it can be used in place
+            out.put(0);
+
+            entries.push_back(entry);
+            names += name;
+            LOG(INFO) << "Packed " << name << ", " << entry.size << " bytes";
+        }
+    }
+
+    pad(out);
+    header.entriesOffset = static_cast<std::uint64_t>(out.tellp());
+    header.entryCount = static_cast<std::uint32_t>(entries.size());
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    out.write(names.data(), names.size());
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!out) {
+        throw std::runtime_error("Cannot write bundle " + filename);
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Image.h"
+
+namespace billiard {
+
+/**
+* Read only view of an asset bundle mapped into memory. A bundle holds
+* shader sources and decoded texels, so startup reads one file front to
+* back instead of opening and decoding every asset. Layout is a Header,
+* 16 byte aligned blobs, then the Entry table and the names it points to.
+*/
+class Bundle
+{
+public:
+    static const char MAGIC[8];
+    static const std::uint32_t VERSION = 1;
+
+    enum Type {
+        TEXT = 0,
+        IMAGE = 1
+    };
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint64_t entriesOffset;
+    };
+
+    struct Entry {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint32_t nameOffset; // from the end of the entry table
+        std::uint32_t nameLength;
+        std::uint32_t type;
+        // images only, texels are laid out as image::Info describes them
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t channels;
+        std::uint32_t levels;
+        std::uint32_t padding;
+    };
+
+private:
+    const unsigned char *data_;
+    size_t size_;
+#ifdef _WIN32
+    void *file_;
+    void *mapping_;
+#else
+    int file_;
+#endif
+    std::unordered_map<std::string, const Entry *> entries_;
+
+    void unmap();
+
+public:
+    // maps filename and reads its table. Throws if the file is not a bundle.
+    explicit Bundle(const std::string &filename);
+    ~Bundle();
+
+    Bundle(const Bundle &) = delete;
+    Bundle &operator=(const Bundle &) = delete;
+
+    // entry by path relative to the assets directory, nullptr if absent.
+    const Entry *find(const std::string &name) const;
+
+    const char *text(const Entry &entry) const;
+    // texels point into the mapping, valid as long as the bundle.
+    image::Pixels image(const Entry &entry) const;
+
+    size_t getSize() const { return size_; }
+    int getEntryCount() const { return static_cast<int>(entries_.size()); }
+
+    /*
+        Packs every file of the given directories under root. Pngs are
+        decoded and get full mip chains when mips is set, other files are
+        stored as they are. Throws on I/O errors.
+    */
+    static void pack(const std::string &root, const std::vector<std::string> &directories,
+            const std::string &filename, bool mips);
+};
+
+}
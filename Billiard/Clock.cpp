@@ -0,0 +1,82 @@
+#include "StdAfx.h"
+#include "Clock.h"
+
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#endif
+
+namespace billiard {
+
+Clock::Clock(double step, int maxSteps)
+        : step_(step)
+        , maxSteps_(maxSteps)
+        , last_(Source::now())
+        , accumulator_(0)
+        , steps_(0)
+        , dropped_(0) {
+}
+
+int Clock::advance() {
+    auto now = Source::now();
+    auto elapsed = std::chrono::duration<double>(now - last_).count();
+    last_ = now;
+    return advance(elapsed);
+}
+
+int Clock::advance(double elapsed) {
+    accumulator_ += elapsed;
+    auto steps = static_cast<int>(accumulator_ / step_);
+    if (steps > maxSteps_) {
+        dropped_ += (steps - maxSteps_) * step_;
+        steps = maxSteps_;
+    }
+    accumulator_ -= steps * step_;
+    if (accumulator_ >= step_) {
+        // keep less than a step after dropping, alpha stays in 0..1
+        accumulator_ = std::fmod(accumulator_, step_);
+    }
+    steps_ += steps;
+    return steps;
+}
+
+Clock::Source::duration Clock::untilNextStep() const {
+    auto left = std::chrono::duration<double>(step_ - accumulator_);
+    auto due = last_ + std::chrono::duration_cast<Source::duration>(left);
+    auto now = Source::now();
+    return due > now ? due - now : Source::duration::zero();
+}
+
+FrameLimiter::FrameLimiter(double fps)
+        : period_(fps > 0 ? std::chrono::duration_cast<Clock::Source::duration>(std::chrono::duration<double>(1 / fps)) 
+                          : Clock::Source::duration::zero())
+        , next_(Clock::Source::now()) {
+#ifdef _WIN32
+    // default scheduler tick is ~15 ms, too coarse for frame pacing
+    timeBeginPeriod(1);
+#endif
+}
+
+FrameLimiter::~FrameLimiter() {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FrameLimiter::wait() {
+    if (period_ == Clock::Source::duration::zero()) {
+        return;
+    }
+    next_ += period_;
+    auto now = Clock::Source::now();
+    if (next_ < now) {
+        // too far behind, start over instead of rushing the next frames
+        next_ = now;
+        return;
+    }
+    std::this_thread::sleep_until(next_);
+}
+
+}
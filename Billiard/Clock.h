@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace billiard {
+
+/**
+* Turns elapsed time into a number of fixed simulation steps. Leftover time
+* is kept for the next call and exposed as the interpolation alpha. When
+* steps cannot keep up (a debugger break, a slow frame), at most maxSteps 
+* run per call and the rest is dropped, so catching up never feeds on itself.
+*/
+class Clock
+{
+public:
+    typedef std::chrono::steady_clock Source;
+
+private:
+    const double step_;
+    const int maxSteps_;
+
+    Source::time_point last_;
+    double accumulator_;
+    std::uint64_t steps_;
+    double dropped_;
+
+public:
+    explicit Clock(double step, int maxSteps = 5);
+
+    // wall time since the previous call (or construction), returns steps to run now.
+    int advance();
+
+    // the same for an explicit elapsed time, for runs that must not depend on speed.
+    int advance(double elapsed);
+
+    // how far past the last step the time is, in steps, 0..1.
+    float getAlpha() const { return static_cast<float>(accumulator_ / step_); }
+
+    // wall time left until the next step is due.
+    Source::duration untilNextStep() const;
+
+    double getStep() const { return step_; }
+    std::uint64_t getSteps() const { return steps_; }
+    double getTime() const { return steps_ * step_; }
+
+    // seconds thrown away by the max steps cap.
+    double getDroppedTime() const { return dropped_; }
+};
+
+/**
+* Caps the frame rate by sleeping until the next frame is due instead of
+* spinning, so a headless instance can idle between frames.
+*/
+class FrameLimiter
+{
+    Clock::Source::duration period_;
+    Clock::Source::time_point next_;
+
+public:
+    // fps == 0 disables the limit.
+    explicit FrameLimiter(double fps);
+    ~FrameLimiter();
+
+    FrameLimiter(const FrameLimiter &) = delete;
+    FrameLimiter &operator=(const FrameLimiter &) = delete;
+
+    // call once per frame.
+    void wait();
+};
+
+}
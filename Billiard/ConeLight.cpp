@@ -26,15 +26,4 @@ glm::mat4 ConeLight::computeProjViewMat() const {
     return depthProjMat * depthView;
 }
 
-void ConeLight::bind(const glsl::Program &program, const Frustum &frustum) const {
-    auto viewSpacePos = frustum.getView() * position_;
-    program.setUniformVec3("u_Light0Pos", glm::value_ptr(viewSpacePos));
-    program.setUniformFloat("u_Light0SpotExp", spotExponent_);
-
-    auto spotDir = frustum.getNormal() * direction_;
-    program.setUniformVec3("u_Light0SpotDir", glm::value_ptr(spotDir));
-    
-    program.setUniformFloat("u_Light0SpotCosCutoff", static_cast<float>(std::cos(spotCutoff_ * M_PI / 180)));
-}
-
 }
\ No newline at end of file
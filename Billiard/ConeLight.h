@@ -2,9 +2,6 @@
 
 #include <glm\glm.hpp>
 
-#include "GlslProgram.h"
-#include "Frustum.h"
-
 namespace billiard {
 
 class ConeLight
@@ -27,12 +24,11 @@ public:
     glm::mat4 computeProjViewMat() const;
     float getSpotCutoff() const { return spotCutoff_; }
     float getTanPhi() const { return tanPhi_; }
+    float getSpotExponent() const { return spotExponent_; }
 
     glm::vec3 pos() const { return glm::vec3(position_); }
     const glm::vec3 &dir() const { return direction_; }
     float length() const { return length_; }
-
-    void bind(const glsl::Program &program, const Frustum &frustum) const;
 };
 
 }
\ No newline at end of file
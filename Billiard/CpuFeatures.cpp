@@ -0,0 +1,65 @@
+#include "StdAfx.h"
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+    #include <intrin.h>
+    #include <immintrin.h>
+#else
+    #include <cpuid.h>
+#endif
+
+namespace billiard {
+namespace cpu {
+
+namespace {
+    void cpuid(int leaf, int *regs) {
+#ifdef _MSC_VER
+        __cpuidex(regs, leaf, 0);
+#else
+        __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    // which register states the OS saves on context switch.
+    unsigned long long xgetbv() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+}
+
+bool hasSse2() {
+    int regs[4];
+    cpuid(1, regs);
+    return (regs[3] & (1 << 26)) != 0;
+}
+
+bool hasSsse3() {
+    int regs[4];
+    cpuid(1, regs);
+    return (regs[2] & (1 << 9)) != 0;
+}
+
+bool hasAvx2() {
+    int regs[4];
+    cpuid(0, regs);
+    auto maxLeaf = regs[0];
+
+    cpuid(1, regs);
+    auto osxsave = (regs[2] & (1 << 27)) != 0;
+    auto avx = (regs[2] & (1 << 28)) != 0;
+
+    // xmm and ymm state must be enabled by the OS too
+    if (maxLeaf < 7 || !osxsave || !avx || (xgetbv() & 6) != 6) {
+        return false;
+    }
+    cpuid(7, regs);
+    return (regs[1] & (1 << 5)) != 0;
+}
+
+}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+namespace billiard {
+namespace cpu {
+
+// instruction sets supported by the CPU, and by the OS where they add register state.
+bool hasSse2();
+bool hasSsse3();
+bool hasAvx2();
+
+}
+}
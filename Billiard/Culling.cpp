@@ -0,0 +1,38 @@
+#include "StdAfx.h"
+#include "Culling.h"
+
+#include <xmmintrin.h>
+
+namespace billiard {
+namespace culling {
+
+int cullSpheres(const Plane *planes, int planeCount, const float *x, const float *y,
+        float z, float radius, int count, int *visible) {
+    const auto negRadius = _mm_set1_ps(-radius);
+    auto visibleCount = 0;
+    for (int i = 0; i < count; i += 4) {
+        auto px = _mm_loadu_ps(x + i);
+        auto py = _mm_loadu_ps(y + i);
+
+        auto outside = _mm_setzero_ps();
+        for (int p = 0; p < planeCount; p++) {
+            const auto &plane = planes[p];
+            // z is the same for all spheres, so it folds into the constant term
+            auto d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x())), 
+                                           _mm_mul_ps(py, _mm_set1_ps(plane.y()))),
+                                _mm_set1_ps(plane.z() * z + plane.w()));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negRadius));
+        }
+
+        auto inside = ~_mm_movemask_ps(outside);
+        for (int k = 0; k < 4 && i + k < count; k++) {
+            if (inside & (1 << k)) {
+                visible[visibleCount++] = i + k;
+            }
+        }
+    }
+    return visibleCount;
+}
+
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Plane.h"
+
+namespace billiard {
+namespace culling {
+
+/**
+* Bounding sphere tests against convex volumes, such as Frustum planes. 
+* Planes must be normalized and point inside, a sphere is culled when it lies
+* entirely behind one of them. Four spheres are tested per SSE iteration.
+*/
+
+// spheres of one radius centered at (x[i], y[i], z). x and y must be readable
+// up to count rounded up to 4, they need no alignment. Writes indices of spheres 
+// which are at least partially inside into visible, returns their number.
+int cullSpheres(const Plane *planes, int planeCount, const float *x, const float *y,
+    float z, float radius, int count, int *visible);
+
+}
+}
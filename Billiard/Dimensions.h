@@ -0,0 +1,7 @@
+#pragma once
+
+// world units: the table is TABLE_WIDTH x TABLE_HEIGHT, balls rest on z = 0.
+#define BALL_DIAMETER 0.68f
+
+#define TABLE_WIDTH 10.0f
+#define TABLE_HEIGHT 10.0f
@@ -0,0 +1,125 @@
+#include "StdAfx.h"
+#include "DynamicBuffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+namespace {
+    const GLuint64 WAIT_NS = 1000000000;
+
+    // not an indexed or VAO target, so mapping leaves draw state alone
+    const GLenum TARGET = GL_COPY_WRITE_BUFFER;
+}
+
+DynamicBuffer::DynamicBuffer(size_t frameSize)
+        : buffer_(0)
+        , frameSize_(frameSize)
+        , mapped_(nullptr)
+        , frame_(0)
+        , used_(0)
+        , stalls_(0) {
+    for (auto &fence : fences_) {
+        fence = nullptr;
+    }
+
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(TARGET, buffer_);
+    auto size = frameSize_ * FRAMES;
+    if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(TARGET, size, nullptr, flags);
+        mapped_ = static_cast<unsigned char *>(glMapBufferRange(TARGET, 0, size, flags));
+        if (!mapped_) {
+            LOG(WARNING) << "Cannot map dynamic buffer persistently, mapping every write";
+        }
+    }
+    if (!mapped_) {
+        // storage from glBufferStorage is immutable, start over with a fresh name
+        if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+            glDeleteBuffers(1, &buffer_);
+            glGenBuffers(1, &buffer_);
+            glBindBuffer(TARGET, buffer_);
+        }
+        glBufferData(TARGET, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(TARGET, 0);
+}
+
+DynamicBuffer::~DynamicBuffer() {
+    for (auto fence : fences_) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (mapped_) {
+        glBindBuffer(TARGET, buffer_);
+        glUnmapBuffer(TARGET);
+        glBindBuffer(TARGET, 0);
+    }
+    glDeleteBuffers(1, &buffer_);
+}
+
+void DynamicBuffer::wait(GLsync fence) {
+    auto status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+        return;
+    }
+    stalls_++;
+    do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_NS);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    if (status == GL_WAIT_FAILED) {
+        LOG(ERROR) << "Waiting for dynamic buffer fence failed";
+    }
+}
+
+void DynamicBuffer::beginFrame() {
+    if (fences_[frame_]) {
+        glDeleteSync(fences_[frame_]);
+    }
+    fences_[frame_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    frame_ = (frame_ + 1) % FRAMES;
+    used_ = 0;
+    stalls_ = 0;
+    if (fences_[frame_]) {
+        wait(fences_[frame_]);
+        glDeleteSync(fences_[frame_]);
+        fences_[frame_] = nullptr;
+    }
+}
+
+GLintptr DynamicBuffer::write(const void *data, size_t size, size_t alignment) {
+    auto start = (used_ + alignment - 1) / alignment * alignment;
+    if (start + size > frameSize_) {
+        throw std::runtime_error("Dynamic buffer frame is full");
+    }
+    used_ = start + size;
+
+    auto offset = frame_ * frameSize_ + start;
+    if (size == 0) {
+        return static_cast<GLintptr>(offset);
+    }
+    if (mapped_) {
+        std::memcpy(mapped_ + offset, data, size);
+    } else {
+        // the fence guarantees nothing reads this range, no need to sync
+        glBindBuffer(TARGET, buffer_);
+        auto flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+        auto target = glMapBufferRange(TARGET, offset, size, flags);
+        if (target) {
+            std::memcpy(target, data, size);
+            glUnmapBuffer(TARGET);
+        } else {
+            LOG(ERROR) << "Cannot map " << size << " bytes of dynamic buffer at " << offset;
+        }
+        glBindBuffer(TARGET, 0);
+    }
+    return static_cast<GLintptr>(offset);
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <GL\GL.h>
+
+#include <cstddef>
+
+namespace billiard {
+
+/**
+* Buffer for data rewritten every frame. The storage is split into FRAMES
+* regions used in turn, each frame sub-allocates its writes from its own
+* region, and a fence placed when the next frame begins tells when the GPU
+* is done with it. Writes go to memory mapped once with ARB_buffer_storage,
+* or mapped unsynchronized per write without it, so they neither wait for
+* draws still reading older regions nor reallocate the storage.
+*/
+class DynamicBuffer
+{
+public:
+    static const int FRAMES = 3;
+
+private:
+    GLuint buffer_;
+    const size_t frameSize_;
+    unsigned char *mapped_; // whole buffer when persistent, otherwise nullptr
+    GLsync fences_[FRAMES];
+    int frame_;
+    size_t used_; // bytes of the current region
+    int stalls_; // of the current frame
+
+    void wait(GLsync fence);
+
+public:
+    // frameSize is what one frame may write at most.
+    explicit DynamicBuffer(size_t frameSize);
+    ~DynamicBuffer();
+
+    DynamicBuffer(const DynamicBuffer &) = delete;
+    DynamicBuffer &operator=(const DynamicBuffer &) = delete;
+
+    operator GLuint() const { return buffer_; }
+
+    bool isPersistent() const { return mapped_ != nullptr; }
+
+    /*
+        Fences what the previous frame wrote and moves to the next region,
+        waiting only if the GPU still reads it from FRAMES frames ago.
+    */
+    void beginFrame();
+
+    // copies data into the current region, returns its offset in the buffer.
+    // throws when the frame writes more than frameSize.
+    GLintptr write(const void *data, size_t size, size_t alignment = 16);
+
+    // 1 when the current frame had to wait for the GPU, 0 otherwise.
+    int getStalls() const { return stalls_; }
+};
+
+}
@@ -0,0 +1,352 @@
+#include "StdAfx.h"
+#include "EventSolver.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+namespace {
+    // per call, past it the rest of the interval is stepped.
+    const int MAX_EVENTS = 10000;
+    const double FALLBACK_STEP = 1.0 / 1000;
+
+    // slower contacts are grazing ones, their response is negligible and
+    // round-off can keep predicting them at the same moment forever.
+    const double MIN_APPROACH_SPEED = 1e-5;
+
+    bool later(const EventSolver::Event &a, const EventSolver::Event &b) {
+        if (a.time != b.time) {
+            return a.time > b.time;
+        }
+        if (a.type != b.type) {
+            return a.type > b.type;
+        }
+        return a.i != b.i ? a.i > b.i : a.j > b.j;
+    }
+
+    // c[0] + c[1] * t + ... + c[degree] * t^degree
+    double evaluate(const double *c, int degree, double t) {
+        double result = c[degree];
+        for (int k = degree - 1; k >= 0; k--) {
+            result = result * t + c[k];
+        }
+        return result;
+    }
+
+    // root of a polynomial monotonic on [a, b] with f(a), f(b) of different signs.
+    double refineRoot(const double *c, int degree, double a, double b, double fa, double fb) {
+        // Illinois variant of regula falsi
+        int side = 0;
+        for (int iteration = 0; iteration < 64 && b - a > 1e-12; iteration++) {
+            auto t = (a * fb - b * fa) / (fb - fa);
+            auto ft = evaluate(c, degree, t);
+            if (ft == 0) {
+                return t;
+            }
+            if ((ft > 0) == (fa > 0)) {
+                a = t;
+                fa = ft;
+                if (side == -1) {
+                    fb /= 2;
+                }
+                side = -1;
+            } else {
+                b = t;
+                fb = ft;
+                if (side == 1) {
+                    fa /= 2;
+                }
+                side = 1;
+            }
+        }
+        return (a + b) / 2;
+    }
+
+    /*  Finds roots in [t0, t1] in ascending order. Roots of the derivative
+        split the range into monotonic intervals, each has at most one root. */
+    int findRoots(const double *c, int degree, double t0, double t1, double *roots) {
+        while (degree > 0 && c[degree] == 0) {
+            degree--;
+        }
+        if (degree == 0) {
+            return 0;
+        }
+        if (degree == 1) {
+            auto t = -c[0] / c[1];
+            if (t < t0 || t > t1) {
+                return 0;
+            }
+            roots[0] = t;
+            return 1;
+        }
+
+        double derivative[4];
+        for (int k = 1; k <= degree; k++) {
+            derivative[k - 1] = k * c[k];
+        }
+
+        double bounds[6];
+        bounds[0] = t0;
+        auto count = 1 + findRoots(derivative, degree - 1, t0, t1, bounds + 1);
+        bounds[count++] = t1;
+
+        int result = 0;
+        auto fa = evaluate(c, degree, bounds[0]);
+        for (int k = 1; k < count; k++) {
+            auto a = bounds[k - 1];
+            auto b = bounds[k];
+            auto fb = evaluate(c, degree, b);
+            if (fa == 0) {
+                if (result == 0 || roots[result - 1] != a) {
+                    roots[result++] = a;
+                }
+            } else if ((fa < 0) != (fb < 0) && fb != 0) {
+                roots[result++] = refineRoot(c, degree, a, b, fa, fb);
+            }
+            fa = fb;
+        }
+        if (fa == 0) {
+            roots[result++] = t1;
+        }
+        return result;
+    }
+
+    // max distance a ball travels in t seconds.
+    double reach(const BallSystem &balls, int i, double t) {
+        return glm::length(balls.velocity(i)) * t + glm::length(balls.acceleration(i)) * t * t / 2;
+    }
+}
+
+EventSolver::EventSolver() : now_(0), events_(0), synced_(false), syncedCount_(0) {
+    queue_.reserve(BallSystem::MAX_BALLS * BallSystem::MAX_BALLS * 2);
+}
+
+void EventSolver::push(const Event &event) {
+    queue_.push_back(event);
+    std::push_heap(queue_.begin(), queue_.end(), later);
+}
+
+EventSolver::Event EventSolver::pop() {
+    std::pop_heap(queue_.begin(), queue_.end(), later);
+    auto event = queue_.back();
+    queue_.pop_back();
+    return event;
+}
+
+bool EventSolver::isValid(const Event &event) const {
+    if (versions_[event.i] != event.versionI) {
+        return false;
+    }
+    return event.type != EventType::Collision || versions_[event.j] == event.versionJ;
+}
+
+void EventSolver::predictBall(const BallSystem &balls, int i) {
+    auto horizon = balls.timeToTransition(i);
+    if (horizon == std::numeric_limits<float>::infinity()) {
+        return;
+    }
+    push(Event { now_ + horizon, EventType::Transition, i, 0, versions_[i], 0 });
+
+    auto p = balls.position(i);
+    auto v = balls.velocity(i);
+    auto a = balls.acceleration(i);
+
+    for (int axis = 0; axis < 2; axis++) {
+        auto limit = BallSystem::cushionLimit(axis);
+
+        // the ball moves towards one rail only at the moment of impact
+        for (float rail = -1; rail <= 1; rail += 2) {
+            double c[3] = { p[axis] - rail * limit, v[axis], a[axis] / 2 };
+            double roots[2];
+            auto count = findRoots(c, 2, 0, horizon, roots);
+            for (int k = 0; k < count; k++) {
+                if ((v[axis] + a[axis] * roots[k]) * rail > 0) {
+                    push(Event { now_ + roots[k], EventType::Cushion, i, axis, versions_[i], 0 });
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void EventSolver::predictPair(const BallSystem &balls, int i, int j) {
+    auto horizon = std::min(balls.timeToTransition(i), balls.timeToTransition(j));
+    if (horizon == std::numeric_limits<float>::infinity()) {
+        return;
+    }
+
+    // relative motion d(t) = dp + dv * t + da * t^2 / 2
+    auto dp = balls.position(j) - balls.position(i);
+    auto dv = balls.velocity(j) - balls.velocity(i);
+    auto da = (balls.acceleration(j) - balls.acceleration(i)) / 2.0f;
+
+    auto gap = glm::length(dp) - BALL_DIAMETER;
+    if (gap > reach(balls, i, horizon) + reach(balls, j, horizon)) {
+        return;
+    }
+
+    // |d(t)|^2 - D^2 = 0
+    double c[5] = {
+        glm::dot(dp, dp) - BALL_DIAMETER * BALL_DIAMETER,
+        2.0 * glm::dot(dp, dv),
+        glm::dot(dv, dv) + 2.0 * glm::dot(dp, da),
+        2.0 * glm::dot(dv, da),
+        glm::dot(da, da)
+    };
+
+    // d/dt |d|^2 = 2 * D * normal speed at the contact
+    const double minSlope = -2 * BALL_DIAMETER * MIN_APPROACH_SPEED;
+
+    // touching already because of round-off
+    if (c[0] <= 0 && c[1] < minSlope) {
+        push(Event { now_, EventType::Collision, i, j, versions_[i], versions_[j] });
+        return;
+    }
+
+    double roots[4];
+    auto count = findRoots(c, 4, 0, horizon, roots);
+    for (int k = 0; k < count; k++) {
+        // balls must be approaching, otherwise it is separation after a contact
+        auto slope = c[1] + roots[k] * (2 * c[2] + roots[k] * (3 * c[3] + roots[k] * 4 * c[4]));
+        if (slope < minSlope) {
+            push(Event { now_ + roots[k], EventType::Collision, i, j, versions_[i], versions_[j] });
+            return;
+        }
+    }
+}
+
+void EventSolver::reset(const BallSystem &balls) {
+    queue_.clear();
+    std::fill(std::begin(versions_), std::end(versions_), 0);
+    now_ = 0;
+
+    for (int i = 0; i < balls.count(); i++) {
+        predictBall(balls, i);
+        for (int j = i + 1; j < balls.count(); j++) {
+            predictPair(balls, i, j);
+        }
+    }
+}
+
+void EventSolver::sync(const BallSystem &balls) {
+    if (!synced_ || syncedCount_ != balls.count()) {
+        reset(balls);
+        return;
+    }
+
+    int touched[BallSystem::MAX_BALLS];
+    int count = 0;
+    for (int i = 0; i < balls.count(); i++) {
+        const auto &motion = syncedMotion_[i];
+        if (motion.position != balls.position(i) || motion.velocity != balls.velocity(i)
+            || motion.angularVelocity != balls.angularVelocity(i) || motion.state != balls.state(i)) {
+            touched[count++] = i;
+        }
+    }
+    if (count > 0) {
+        invalidate(balls, touched, count);
+    }
+}
+
+void EventSolver::remember(const BallSystem &balls) {
+    syncedCount_ = balls.count();
+    for (int i = 0; i < balls.count(); i++) {
+        auto &motion = syncedMotion_[i];
+        motion.position = balls.position(i);
+        motion.velocity = balls.velocity(i);
+        motion.angularVelocity = balls.angularVelocity(i);
+        motion.state = balls.state(i);
+    }
+}
+
+void EventSolver::invalidate(const BallSystem &balls, const int *touched, int count) {
+    for (int k = 0; k < count; k++) {
+        versions_[touched[k]]++;
+    }
+
+    for (int k = 0; k < count; k++) {
+        auto i = touched[k];
+        predictBall(balls, i);
+        for (int j = 0; j < balls.count(); j++) {
+            // pairs of two touched balls are predicted once, by the first
+            if (j == i || std::find(touched, touched + k, j) != touched + k) {
+                continue;
+            }
+            predictPair(balls, std::min(i, j), std::max(i, j));
+        }
+    }
+}
+
+void EventSolver::apply(BallSystem &balls, const Event &event) {
+    switch (event.type) {
+    case EventType::Collision:
+        balls.collide(event.i, event.j);
+        break;
+    case EventType::Cushion:
+        balls.collideCushion(event.i, event.j);
+        break;
+    default:
+        // BallSystem::advance already switched the state.
+        break;
+    }
+
+    int touched[2] = { event.i, event.j };
+    invalidate(balls, touched, event.type == EventType::Collision ? 2 : 1);
+}
+
+void EventSolver::run(BallSystem &balls, double until) {
+    while (!queue_.empty() && queue_.front().time <= until) {
+        auto event = pop();
+        if (!isValid(event)) {
+            continue;
+        }
+
+        if (events_ >= MAX_EVENTS) {
+            LOG(WARNING) << "too many events, stepping from " << now_ << " to " << until;
+            queue_.clear();
+            synced_ = false;
+
+            // balls at rest are left where they are, so the steps end with them
+            while (now_ < until && balls.isMoving()) {
+                auto dt = std::min(FALLBACK_STEP, until - now_);
+                balls.step(static_cast<float>(dt));
+                now_ += dt;
+            }
+            break;
+        }
+
+        balls.advance(static_cast<float>(event.time - now_));
+        now_ = event.time;
+        apply(balls, event);
+        events_++;
+    }
+
+    if (until > now_ && until != std::numeric_limits<double>::infinity()) {
+        balls.advance(static_cast<float>(until - now_));
+        now_ = until;
+    }
+}
+
+int EventSolver::advance(BallSystem &balls, float dt) {
+    events_ = 0;
+    sync(balls);
+    synced_ = true;
+    run(balls, now_ + dt);
+    remember(balls);
+    return events_;
+}
+
+int EventSolver::simulate(BallSystem &balls, float maxTime) {
+    events_ = 0;
+    reset(balls);
+    synced_ = true;
+    run(balls, maxTime);
+    remember(balls);
+    return events_;
+}
+
+}
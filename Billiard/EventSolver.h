@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "BallSystem.h"
+
+namespace billiard {
+
+/**
+* Advances BallSystem from event to event instead of using fixed steps.
+* Events are ball-ball and ball-cushion impacts and state transitions, their
+* times are computed analytically from the piecewise quadratic ball motion.
+*/
+class EventSolver
+{
+public:
+    enum class EventType : unsigned char {
+        Transition,
+        Cushion, // j is axis: 0 for x, 1 for y
+        Collision
+    };
+
+    struct Event {
+        double time;
+        EventType type;
+        int i;
+        int j;
+        unsigned int versionI;
+        unsigned int versionJ;
+    };
+
+private:
+    // what a ball looked like when the queue last matched it.
+    struct Motion {
+        glm::vec2 position;
+        glm::vec2 velocity;
+        glm::vec3 angularVelocity;
+        BallSystem::State state;
+    };
+
+    // binary heap, earliest event on top.
+    std::vector<Event> queue_;
+
+    // bumped each time a ball changes its motion, so stale events are dropped.
+    unsigned int versions_[BallSystem::MAX_BALLS];
+
+    double now_;
+    int events_;
+
+    // the queue carries over between advance calls while this is set.
+    bool synced_;
+    int syncedCount_;
+    Motion syncedMotion_[BallSystem::MAX_BALLS];
+
+    void push(const Event &event);
+    Event pop();
+
+    void predictBall(const BallSystem &balls, int i);
+    void predictPair(const BallSystem &balls, int i, int j);
+
+    bool isValid(const Event &event) const;
+    void apply(BallSystem &balls, const Event &event);
+
+    // drops the events of the given balls and predicts theirs anew.
+    void invalidate(const BallSystem &balls, const int *touched, int count);
+
+    void reset(const BallSystem &balls);
+
+    // keeps the queue when only some balls changed since the last advance.
+    void sync(const BallSystem &balls);
+    void remember(const BallSystem &balls);
+
+    // processes events up to the time limit or until all balls stop,
+    // finishing with fixed steps when there are too many of them.
+    void run(BallSystem &balls, double until);
+public:
+    EventSolver();
+
+    // moves balls by dt, returns number of processed events. Balls struck
+    // or placed since the previous call are predicted again, the rest of
+    // the queue is kept.
+    int advance(BallSystem &balls, float dt);
+
+    // runs until all balls stop, but at most maxTime seconds.
+    int simulate(BallSystem &balls, float maxTime);
+
+    // events processed during the last advance or simulate call.
+    int getEventCount() const { return events_; }
+};
+
+}
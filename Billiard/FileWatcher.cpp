@@ -0,0 +1,127 @@
+#include "StdAfx.h"
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+namespace {
+    // how often the thread checks whether it should stop
+    const int WAIT_MS = 100;
+}
+
+FileWatcher::FileWatcher(const std::string &directory)
+        : directory_(directory)
+        , stopping_(false) {
+#ifdef _WIN32
+    scan(false);
+    notification_ = FindFirstChangeNotificationA(directory_.c_str(), FALSE,
+        FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+    if (notification_ == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Cannot watch " + directory_);
+    }
+#else
+    inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    // editors either rewrite the file or move a new one over it
+    if (inotify_ < 0 || inotify_add_watch(inotify_, directory_.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        if (inotify_ >= 0) {
+            close(inotify_);
+        }
+        throw std::runtime_error("Cannot watch " + directory_);
+    }
+#endif
+    thread_ = std::thread(&FileWatcher::loop, this);
+}
+
+FileWatcher::~FileWatcher() {
+    stopping_ = true;
+    thread_.join();
+#ifdef _WIN32
+    FindCloseChangeNotification(notification_);
+#else
+    close(inotify_);
+#endif
+}
+
+void FileWatcher::report(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (std::find(changed_.begin(), changed_.end(), name) == changed_.end()) {
+        changed_.push_back(name);
+    }
+}
+
+std::vector<std::string> FileWatcher::poll() {
+    std::vector<std::string> changed;
+    std::lock_guard<std::mutex> lock(mutex_);
+    changed.swap(changed_);
+    return changed;
+}
+
+#ifdef _WIN32
+
+void FileWatcher::scan(bool report) {
+    WIN32_FIND_DATAA data;
+    auto find = FindFirstFileA((directory_ + "/*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+        auto time = (static_cast<unsigned long long>(data.ftLastWriteTime.dwHighDateTime) << 32)
+            | data.ftLastWriteTime.dwLowDateTime;
+        auto &known = writeTimes_[data.cFileName];
+        if (report && known != time) {
+            this->report(data.cFileName);
+        }
+        known = time;
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+}
+
+void FileWatcher::loop() {
+    while (!stopping_) {
+        if (WaitForSingleObject(notification_, WAIT_MS) == WAIT_OBJECT_0) {
+            scan(true);
+            FindNextChangeNotification(notification_);
+        }
+    }
+}
+
+#else
+
+void FileWatcher::loop() {
+    alignas(inotify_event) char buffer[4096];
+    pollfd fd = { inotify_, POLLIN, 0 };
+    while (!stopping_) {
+        if (::poll(&fd, 1, WAIT_MS) <= 0) {
+            continue;
+        }
+        ssize_t length;
+        while ((length = read(inotify_, buffer, sizeof(buffer))) > 0) {
+            for (auto p = buffer; p < buffer + length; ) {
+                auto event = reinterpret_cast<const inotify_event *>(p);
+                if (event->len > 0) {
+                    report(event->name);
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+#endif
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+    #include <unordered_map>
+#endif
+
+namespace billiard {
+
+/**
+* Reports files of one directory that were written or replaced. Changes
+* are collected on a background thread with inotify, or directory change
+* notifications on Windows, and handed out by poll() on any thread.
+*/
+class FileWatcher
+{
+    const std::string directory_;
+
+    std::mutex mutex_;
+    std::vector<std::string> changed_;
+
+    std::atomic<bool> stopping_;
+#ifdef _WIN32
+    void *notification_;
+    // last write times, a notification only says that something changed
+    std::unordered_map<std::string, unsigned long long> writeTimes_;
+
+    void scan(bool report);
+#else
+    int inotify_;
+#endif
+    std::thread thread_;
+
+    void loop();
+    void report(const std::string &name);
+
+public:
+    // throws if the directory cannot be watched.
+    explicit FileWatcher(const std::string &directory);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    // names relative to the directory changed since the last call, each once.
+    std::vector<std::string> poll();
+};
+
+}
@@ -0,0 +1,65 @@
+#include "StdAfx.h"
+#include "FrameUniforms.h"
+
+#include <cmath>
+
+#include "utils.h"
+
+namespace billiard {
+
+const char *const FrameUniforms::BLOCK_NAME = "FrameUniforms";
+
+const char *const FrameUniforms::SOURCE =
+    "layout(std140) uniform FrameUniforms {\n"
+    "    mat4 u_ViewMat;\n"
+    "    mat4 u_ProjectionMat;\n"
+    "    mat4 u_ViewProjMat;\n"
+    "    mat4 u_LightProjViewMat;\n"
+    "    mat4 u_DepthBiasMat;\n"
+    "    vec3 u_CameraWorldPos;\n"
+    "    float u_NearPlane;\n"
+    "    vec3 u_Light0Pos;\n"
+    "    float u_Light0SpotExp;\n"
+    "    vec3 u_Light0SpotDir;\n"
+    "    float u_Light0SpotCosCutoff;\n"
+    "    float u_FarPlane;\n"
+    "    float u_Light0TanPhi;\n"
+    "    float u_Light0Length;\n"
+    "};\n";
+
+FrameUniforms::FrameUniforms() {
+    ubo_.bind<GL_UNIFORM_BUFFER>();
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+    VertexBuffer::unbind<GL_UNIFORM_BUFFER>();
+}
+
+void FrameUniforms::update(const Frustum &frustum, const ConeLight &light) {
+    const auto &view = frustum.getView();
+    auto lightProjView = light.computeProjViewMat();
+
+    block_.viewMat = view;
+    block_.projectionMat = frustum.getProj();
+    block_.viewProjMat = frustum.getViewProj();
+    block_.lightProjViewMat = lightProjView;
+    block_.depthBiasMat = utils::biasMatrix * lightProjView;
+
+    auto cameraWorldPos = glm::inverse(view) * glm::vec4(0, 0, 0, 1);
+    block_.cameraWorldPos = glm::vec3(cameraWorldPos / cameraWorldPos.w);
+    block_.nearPlane = frustum.getNear();
+    block_.farPlane = frustum.getFar();
+
+    block_.light0Pos = glm::vec3(view * glm::vec4(light.pos(), 1));
+    block_.light0SpotExp = light.getSpotExponent();
+    block_.light0SpotDir = frustum.getNormal() * light.dir();
+    block_.light0SpotCosCutoff = static_cast<float>(std::cos(light.getSpotCutoff() * M_PI / 180));
+    block_.light0TanPhi = light.getTanPhi();
+    block_.light0Length = light.length();
+    block_.padding = 0;
+
+    ubo_.bind<GL_UNIFORM_BUFFER>();
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block_);
+    VertexBuffer::unbind<GL_UNIFORM_BUFFER>();
+    ubo_.bindBase<GL_UNIFORM_BUFFER>(BINDING);
+}
+
+}
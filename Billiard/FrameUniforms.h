@@ -0,0 +1,58 @@
+#pragma once
+
+#include <GL\glew.h>
+#include <glm\glm.hpp>
+
+#include "VertexBuffer.h"
+#include "Frustum.h"
+#include "ConeLight.h"
+
+namespace billiard {
+
+/**
+* Camera and light state shared by every program through one std140 uniform
+* block. It is uploaded once per frame and stays bound at BINDING, programs
+* get the block declaration prepended to their sources by glsl::Program.
+*/
+class FrameUniforms
+{
+public:
+    static const GLuint BINDING = 0;
+    static const char *const BLOCK_NAME;
+    static const char *const SOURCE;
+
+private:
+    // mirrors SOURCE, vec3 + float pairs share one std140 slot.
+    struct Block {
+        glm::mat4 viewMat;
+        glm::mat4 projectionMat;
+        glm::mat4 viewProjMat;
+        glm::mat4 lightProjViewMat;
+        glm::mat4 depthBiasMat;
+        glm::vec3 cameraWorldPos;
+        float nearPlane;
+        glm::vec3 light0Pos; // eye space
+        float light0SpotExp;
+        glm::vec3 light0SpotDir; // eye space
+        float light0SpotCosCutoff;
+        float farPlane;
+        float light0TanPhi;
+        float light0Length;
+        float padding;
+    };
+    static_assert(sizeof(Block) == 5 * 64 + 4 * 16, "Block must match std140 layout");
+
+    const VertexBuffer ubo_;
+    Block block_;
+
+public:
+    FrameUniforms();
+
+    FrameUniforms(const FrameUniforms &) = delete;
+    FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+    // uploads the block and binds it for the rest of the frame.
+    void update(const Frustum &frustum, const ConeLight &light);
+};
+
+}
@@ -20,23 +20,25 @@ void Frustum::computePlanes() const
         return;
     }
 
-    const glm::mat4 &viewProj = getViewProj();
-    
+    extractPlanes(getViewProj(), mPlanes);
+    mPlanesDirty = false;
+}
+
+void Frustum::extractPlanes(const glm::mat4 &viewProj, Plane (&planes)[6])
+{
     glm::vec4 rows[4];
     for (int i = 0; i < 4; i++) {
         rows[i] = glm::row(viewProj, i);
     }
 
-    mPlanes[0] = createNormalizedPlane(rows[3] + rows[0]);
-    mPlanes[1] = createNormalizedPlane(rows[3] - rows[0]);
+    planes[0] = createNormalizedPlane(rows[3] + rows[0]);
+    planes[1] = createNormalizedPlane(rows[3] - rows[0]);
 
-    mPlanes[2] = createNormalizedPlane(rows[3] + rows[1]);
-    mPlanes[3] = createNormalizedPlane(rows[3] - rows[1]);
+    planes[2] = createNormalizedPlane(rows[3] + rows[1]);
+    planes[3] = createNormalizedPlane(rows[3] - rows[1]);
     
-    mPlanes[4] = createNormalizedPlane(rows[3] + rows[2]);
-    mPlanes[5] = createNormalizedPlane(rows[3] - rows[2]);
-
-    mPlanesDirty = false;
+    planes[4] = createNormalizedPlane(rows[3] + rows[2]);
+    planes[5] = createNormalizedPlane(rows[3] - rows[2]);
 }
 
 const Plane &Frustum::getPlane(int index) const
@@ -45,6 +47,12 @@ const Plane &Frustum::getPlane(int index) const
     return mPlanes[index];
 }
 
+const Plane *Frustum::getPlanes() const
+{
+    computePlanes();
+    return mPlanes;
+}
+
 const glm::mat4 &Frustum::getViewProj() const 
 {
     if (mViewProjDirty) {
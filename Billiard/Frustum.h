@@ -78,6 +78,11 @@ public:
     const glm::vec4 &getCorner(int index) const;
 
     const Plane &getPlane(int index) const;
+    const Plane *getPlanes() const;
+
+    // normalized planes of the clip volume of any view projection, 
+    // normals point inside: left, right, bottom, top, near, far.
+    static void extractPlanes(const glm::mat4 &viewProj, Plane (&planes)[6]);
 };
 
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #include "Game.h"
 
 #include <vector>
+#include <algorithm>
+#include <sstream>
+
+#include <GLFW\glfw3.h>
 
 #include "glm\gtc\matrix_transform.hpp"
 #include "glog\logging.h"
@@ -9,6 +13,8 @@
 #include "utils.h"
 #include "Texture.h"
 #include "Framebuffer.h"
+#include "Image.h"
+#include "GlState.h"
 
 #define checkError if (auto err = glGetError()) { utils::printStack(); LOG(ERROR) << err; };
 
@@ -18,6 +24,8 @@ namespace {
     int shadowMapSize = 1024;
     float shadowMapSizef = static_cast<float>(shadowMapSize);
     float frustumFar = 20.0f;
+    float simulationStep = 1.0f / 60;
+    float cueSpeed = 40.0f;
     
     const float vertices[] =  {
         0, 0, 0, 0, 0,
@@ -70,16 +78,112 @@ namespace {
         return std::move(t);
     }
 
-    void prepareCookie(const Texture &cookie, const char *filename) {
+    const char *const BLUR_VERTEX_SHADER = "shaders/blur.vert";
+    const char *const BLUR_FRAGMENT_SHADER = "shaders/blur.frag";
+    const char *const BLUR_PROGRAM = "blur";
+    const char *const SHAFT_PROGRAM = "shaft";
+    const char *const SHAFT_VERTEX_SHADER = "shaders/shaft.vert";
+    const char *const SHAFT_FRAGMENT_SHADER = "shaders/shaft.frag";
+    const char *const FULLSCREEN_VERTEX_SHADER = "shaders/fullscreen.vert";
+    const char *const UPSAMPLE_PROGRAM = "upsample";
+    const char *const UPSAMPLE_FRAGMENT_SHADER = "shaders/upsample.frag";
+    const char *const MARCH_PROGRAM = "shaftmarch";
+    const char *const MARCH_FRAGMENT_SHADER = "shaders/shaftmarch.frag";
+    const char *const COOKIE = "textures/cookie.png";
+
+    // requests every startup asset, so they load while the GL thread waits for the first.
+    std::unique_ptr<AssetLoader> startLoading(const std::string &exePath) {
+        std::unique_ptr<AssetLoader> assets(new AssetLoader(exePath + "../assets/", exePath + "../assets.bundle"));
+        Table::requestAssets(*assets);
+        Ball::requestAssets(*assets);
+        assets->text(BLUR_VERTEX_SHADER);
+        assets->text(BLUR_FRAGMENT_SHADER);
+        assets->text(SHAFT_VERTEX_SHADER);
+        assets->text(SHAFT_FRAGMENT_SHADER);
+        assets->text(FULLSCREEN_VERTEX_SHADER);
+        assets->text(UPSAMPLE_FRAGMENT_SHADER);
+        assets->text(MARCH_FRAGMENT_SHADER);
+        assets->image(COOKIE);
+        return assets;
+    }
+
+    const unsigned BLUR_VERTICALLY = 1 << 0;
+    const unsigned BLUR_HORIZONTALLY = 1 << 1;
+
+    const unsigned PERSPECTIVE_DEPTH = 1 << 0;
+
+    // screen distance between neighbour slices the shafts still look smooth at
+    const float PIXELS_PER_SLICE = 16.0f;
+
+    // how much of the new ray marched frame goes into the shafts' history
+    const float TEMPORAL_WEIGHT = 0.1f;
+
+    /*
+        Screen box of the points in normalized device coordinates, clamped
+        to the screen. False when one of them is behind the camera, the box
+        is then the whole screen.
+    */
+    template <int N>
+    bool projectBounds(const glm::mat4 &viewProj, const glm::vec3 (&points)[N],
+            glm::vec2 *lower, glm::vec2 *upper) {
+        *lower = glm::vec2(1.0f);
+        *upper = glm::vec2(-1.0f);
+        for (const auto &point : points) {
+            auto clip = viewProj * glm::vec4(point, 1);
+            if (clip.w <= 0) {
+                *lower = glm::vec2(-1.0f);
+                *upper = glm::vec2(1.0f);
+                return false;
+            }
+            auto ndc = glm::clamp(glm::vec2(clip) / clip.w, glm::vec2(-1.0f), glm::vec2(1.0f));
+            *lower = glm::min(*lower, ndc);
+            *upper = glm::max(*upper, ndc);
+        }
+        return true;
+    }
+
+    /*
+        How many slices the cone needs for about PIXELS_PER_SLICE pixels
+        between them: the pixels its points cover on screen, scaled by how
+        much of the cone's size lies along the view. A point behind the
+        camera means the cone fills the view, so it gets maxSlices.
+    */
+    template <int N>
+    int computeShaftSlices(const glm::mat4 &viewProj, const glm::vec3 (&points)[N],
+            float depthExtent, float coneSize, int width, int height, int maxSlices) {
+        glm::vec2 lower, upper;
+        if (!projectBounds(viewProj, points, &lower, &upper)) {
+            return maxSlices;
+        }
+        auto extent = glm::max(upper - lower, glm::vec2(0.0f));
+        auto pixels = std::max(extent.x * width, extent.y * height) / 2;
+        auto alongView = std::min(depthExtent / coneSize, 1.0f);
+        auto slices = static_cast<int>(std::ceil(pixels * alongView / PIXELS_PER_SLICE));
+        return std::min(std::max(slices, 2), maxSlices);
+    }
+
+    int getShaftSize(int surfaceSize, int divisor) {
+        return (surfaceSize + divisor - 1) / divisor;
+    }
+
+    void setupBlur(glsl::Program &blur, unsigned /*flags*/) {
+        auto proj = glm::ortho<float>(0, shadowMapSizef, 0, shadowMapSizef, -1, 1);
+        blur.bind();
+        blur.setUniformInt("u_Texture", 0);
+        blur.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(proj));
+        glsl::Program::unbind();
+    }
+
+    void prepareCookie(const Texture &cookie, const image::Pixels &pixels) {
         cookie.bind<GL_TEXTURE_2D>();
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-        unsigned int w, h, bpp;
-        auto data = utils::loadPng(filename, &w, &h, &bpp);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+        image::Uploader uploader;
+        uploader.upload2D(pixels);
+        image::Uploader::finish();
         glBindTexture(GL_TEXTURE_2D, 0);
     }
 
@@ -207,13 +311,20 @@ namespace {
 
 Game::Game(int surfaceWidth, int surfaceHeight) 
         : exePath_(utils::getExePath())
+        , assets_(startLoading(exePath_))
         , surfaceWidth_(surfaceWidth)
         , surfaceHeight_(surfaceHeight)
+        , targetFramebuffer_(0)
         , cameraRot_(0, -60)
         , cameraDistance_(-2.5f)
         , mouseDown_(false)
-        , table_(exePath_)
-        , ball_(exePath_)
+        , table_(*assets_, programs_)
+        , ball_(*assets_, programs_)
+        , clock_(simulationStep)
+        , fixedTimestep_(false)
+        , alpha_(0)
+        , depthPrepass_(false)
+        , adaptiveSlices_(true)
         , sceneDepthMap_(createDepthMap<GL_TEXTURE_RECTANGLE>(GL_DEPTH24_STENCIL8_EXT, GL_DEPTH_STENCIL_EXT, GL_UNSIGNED_INT_24_8_EXT, surfaceWidth, surfaceHeight))
         , sceneRenderbuffer_(createSceneRenderbuffer(surfaceWidth, surfaceHeight))
         //, sceneDepthMap_(createDepthMap<GL_TEXTURE_RECTANGLE>(GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, surfaceWidth, surfaceHeight))
@@ -224,15 +335,26 @@ Game::Game(int surfaceWidth, int surfaceHeight)
         , depthMap2_(createDepthMap<GL_TEXTURE_2D>(GL_DEPTH24_STENCIL8_EXT, GL_DEPTH_STENCIL_EXT, GL_UNSIGNED_INT_24_8_EXT, shadowMapSize, shadowMapSize))
         , colorMap2_(createColorMap(GL_RGBA32F, GL_RGBA, GL_UNSIGNED_INT, shadowMapSize, shadowMapSize))
         , shadowBuffer2_(createFramebuffer(colorMap2_, depthMap2_, depthMap2_))
-        , blurVertically_("#define BLUR_VERTICALLY\n", 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/blur.vert"), 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/blur.frag"))
-        , blurHorizontally_("#define BLUR_HORIZONTALLY\n", 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/blur.vert"), 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/blur.frag"))
-        , lightshaft_("", 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/shaft.vert"), 
-                   glsl::loadShaderFromFile(exePath_ + "../assets/shaders/shaft.frag"))
+        , blur_(programs_.add(BLUR_PROGRAM, *assets_, { BLUR_VERTEX_SHADER, BLUR_FRAGMENT_SHADER },
+                   { "BLUR_VERTICALLY", "BLUR_HORIZONTALLY" }, setupBlur))
+        , lightshafts_(programs_.add(SHAFT_PROGRAM, *assets_, { SHAFT_VERTEX_SHADER, SHAFT_FRAGMENT_SHADER },
+                   { "PERSPECTIVE_DEPTH" }, [this](glsl::Program &program, unsigned flags) {
+                       setupLightshaft(program, flags);
+                   }))
+        , shaftDivisor_(1)
+        , upsample_(programs_.add(UPSAMPLE_PROGRAM, *assets_, { FULLSCREEN_VERTEX_SHADER, UPSAMPLE_FRAGMENT_SHADER },
+                   { "PERSPECTIVE_DEPTH" }, [this](glsl::Program &program, unsigned flags) {
+                       setupUpsample(program, flags);
+                   }))
+        , shaftTechnique_(ShaftTechnique::Slices)
+        , march_(programs_.add(MARCH_PROGRAM, *assets_, { FULLSCREEN_VERTEX_SHADER, MARCH_FRAGMENT_SHADER },
+                   { "PERSPECTIVE_DEPTH" }, [this](glsl::Program &program, unsigned flags) {
+                       setupMarch(program, flags);
+                   }))
+        , marchSteps_(32)
+        , temporalShafts_(false)
+        , historyValid_(false)
+        , marchJitter_(0)
         , quad_(VertexBuffer::create<GL_ARRAY_BUFFER>(vertices, utils::length(vertices))) 
         
 {
@@ -244,6 +366,10 @@ Game::Game(int surfaceWidth, int surfaceHeight)
     light_.setPosition(glm::vec3(0, 2, 2));
     light_.setDirection(glm::normalize(glm::vec3(0, -2, -2)));
 
+    balls_.rack();
+    latest_.capture(balls_, 0, 0);
+    previous_ = latest_;
+
     glBindVertexArray(quadVao_);
     quad_.bind<GL_ARRAY_BUFFER>();
     glsl::Program::setAttrPtr(0, 3, 5 * sizeof(float), nullptr);
@@ -251,81 +377,287 @@ Game::Game(int surfaceWidth, int surfaceHeight)
     glBindVertexArray(0);
     VertexBuffer::unbind<GL_ARRAY_BUFFER>();
     
-    auto proj = glm::ortho<float>(0, shadowMapSizef, 0, shadowMapSizef, -1, 1);
+    blur_.prepare(BLUR_VERTICALLY);
+    blur_.prepare(BLUR_HORIZONTALLY);
+    lightshafts_.prepare(getLightshaftFlags());
 
-    blurVertically_.bind();
-    blurVertically_.setUniformInt("u_Texture", 0);
-    blurVertically_.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(proj));
+    prepareCookie(cookie_, assets_->image(COOKIE).get());
+    assets_.reset();
 
-    blurHorizontally_.bind();
-    blurHorizontally_.setUniformInt("u_Texture", 0);
-    blurHorizontally_.setUniformMat4("u_ModelviewProjectionMat", false, glm::value_ptr(proj));
-    
+    // the cookie went up while they compiled, broken shaders fail here and not in render
+    programs_.finish();
+
+    // the objects above bound their vertex arrays and buffers directly
+    GlState::forget();
+}
+
+void Game::setLightshaftQuality(int slices, int divisor) {
+    if (slices < 2 || (divisor != 1 && divisor != 2 && divisor != 4)) {
+        throw std::runtime_error("Light shafts need 2 slices or more and a divisor of 1, 2 or 4");
+    }
+    if (slices != lighshaftGeometry_.getPlanes()) {
+        lighshaftGeometry_ = LightShaftGeometry(slices);
+    }
+    shaftDivisor_ = divisor;
+    createShaftTarget();
+    if (rendersShaftsOffscreen()) {
+        upsample_.prepare(getLightshaftFlags());
+    }
+    programs_.finish();
+    setupShaftPrograms();
+    GlState::forget();
+    LOG(INFO) << "Light shafts: " << slices << " slices at 1/" << divisor << " resolution";
+}
+
+void Game::setShaftTechnique(ShaftTechnique technique, int steps, bool temporal) {
+    if (steps < 1) {
+        throw std::runtime_error("Ray marched light shafts need 1 step or more");
+    }
+    shaftTechnique_ = technique;
+    marchSteps_ = steps;
+    temporalShafts_ = temporal;
+    createShaftTarget();
+    if (shaftTechnique_ == ShaftTechnique::RayMarch) {
+        march_.prepare(getLightshaftFlags());
+    }
+    if (rendersShaftsOffscreen()) {
+        upsample_.prepare(getLightshaftFlags());
+    }
+    programs_.finish();
+    setupShaftPrograms();
+    GlState::forget();
+    if (shaftTechnique_ == ShaftTechnique::RayMarch) {
+        LOG(INFO) << "Light shafts ray marched in " << steps << " steps" << (temporal ? ", temporal" : "");
+    }
+}
+
+bool Game::rendersShaftsOffscreen() const {
+    return shaftDivisor_ > 1 || (shaftTechnique_ == ShaftTechnique::RayMarch && temporalShafts_);
+}
+
+void Game::createShaftTarget() {
+    historyValid_ = false;
+    if (!rendersShaftsOffscreen()) {
+        return;
+    }
+    auto width = getShaftSize(surfaceWidth_, shaftDivisor_);
+    auto height = getShaftSize(surfaceHeight_, shaftDivisor_);
+    // half floats, 8 bits band once 32 faint slices add up
+    shaftColor_ = createColorMap(GL_RGBA16F, GL_RGBA, GL_FLOAT, width, height);
+    shaftBuffer_ = createFramebuffer(shaftColor_, 0);
+    Framebuffer::unbind<GL_FRAMEBUFFER>();
+}
+
+unsigned Game::getLightshaftFlags() const {
+    return depthPrepass_ ? 0 : PERSPECTIVE_DEPTH;
+}
+
+glsl::Program &Game::getLightshaft() {
+    return lightshafts_.get(getLightshaftFlags());
+}
+
+void Game::setupLightshaft(glsl::Program &program, unsigned flags) {
+    // a relinked program may place uniforms elsewhere
+    if (flags == getLightshaftFlags()) {
+        coneMinLocation_ = program.getUniformLocation("u_ConeMin");
+        depthScaleLocation_ = program.getUniformLocation("u_DepthScale");
+        sliceWeightLocation_ = program.getUniformLocation("u_SliceWeight");
+        coneDepthLocation_ = program.getUniformLocation("u_ConeDepth");
+        clipPlanesLocation_ = program.getUniformLocation("u_ClipPlanes[0]");
+    }
+
+    program.bind();
+    program.setUniformInt("u_ShadowMap", 0);
+    program.setUniformInt("u_Texture", 1);
+    program.setUniformInt("u_Depth", 2);
+    glsl::Program::unbind();
+}
+
+void Game::setupUpsample(glsl::Program &program, unsigned flags) {
+    if (flags == getLightshaftFlags()) {
+        divisorLocation_ = program.getUniformLocation("u_Divisor");
+    }
+
+    program.bind();
+    program.setUniformInt("u_Shafts", 0);
+    program.setUniformInt("u_Depth", 2);
     glsl::Program::unbind();
+}
 
-    prepareCookie(cookie_, (exePath_ + "../assets/textures/cookie.png").c_str());
+void Game::setupMarch(glsl::Program &program, unsigned flags) {
+    if (flags == getLightshaftFlags()) {
+        marchDepthScaleLocation_ = program.getUniformLocation("u_DepthScale");
+        marchConeDepthLocation_ = program.getUniformLocation("u_ConeDepth");
+        marchStepsLocation_ = program.getUniformLocation("u_Steps");
+        marchJitterLocation_ = program.getUniformLocation("u_Jitter");
+    }
+
+    program.bind();
+    program.setUniformInt("u_ShadowMap", 0);
+    program.setUniformInt("u_Texture", 1);
+    program.setUniformInt("u_Depth", 2);
+    glsl::Program::unbind();
+}
+
+void Game::setDepthPrepass(bool value) {
+    depthPrepass_ = value;
+    setupShaftPrograms();
+}
+
+void Game::setupShaftPrograms() {
+    // locations come from the variants in use, which may have been set up
+    // while the other depth source was
+    auto flags = getLightshaftFlags();
+    setupLightshaft(lightshafts_.get(flags), flags);
+    if (rendersShaftsOffscreen()) {
+        setupUpsample(upsample_.get(flags), flags);
+    }
+    if (shaftTechnique_ == ShaftTechnique::RayMarch) {
+        setupMarch(march_.get(flags), flags);
+    }
+}
+
+void Game::enableShaderReload() {
+    reloader_.reset(new ShaderReloader(exePath_ + "../assets/"));
+    programs_.watch(*reloader_);
+    LOG(INFO) << "Watching shaders for changes";
 }
 
 void Game::renderShadowMap() {
+    auto scope = profiler_.scope("shadowMap");
+
     // render shadowmap.
-    shadowBuffer_.bind<GL_FRAMEBUFFER>();
-    glViewport(0, 0, shadowMapSize, shadowMapSize);
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, shadowBuffer_);
+    GlState::viewport(0, 0, shadowMapSize, shadowMapSize);
     glClearColor(1, 1, 1, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
     ball_.renderShadow();
     glFlush();
 
-    glBindVertexArray(quadVao_);
-    glCullFace(GL_BACK);
+    GlState::bindVertexArray(quadVao_);
+    GlState::cullFace(GL_BACK);
 
     // blur vertically
-    shadowBuffer2_.bind<GL_FRAMEBUFFER>();
-    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    blurVertically_.bind();
-    colorMap_.bind<GL_TEXTURE_2D>();
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    {
+        auto blurScope = profiler_.scope("blurVertically");
+        GlState::bindFramebuffer(GL_FRAMEBUFFER, shadowBuffer2_);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        blur_.get(BLUR_VERTICALLY).bind();
+        GlState::bindTexture(0, GL_TEXTURE_2D, colorMap_);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
 
     // blur horizontally
-    shadowBuffer_.bind<GL_FRAMEBUFFER>();
-    glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    blurHorizontally_.bind();
-    colorMap2_.bind<GL_TEXTURE_2D>();
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    {
+        auto blurScope = profiler_.scope("blurHorizontally");
+        GlState::bindFramebuffer(GL_FRAMEBUFFER, shadowBuffer_);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+        blur_.get(BLUR_HORIZONTALLY).bind();
+        GlState::bindTexture(0, GL_TEXTURE_2D, colorMap2_);
+        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    }
 
-    glBindVertexArray(0);
-    glsl::Program::unbind();
-    Framebuffer::unbind<GL_FRAMEBUFFER>();
-    glViewport(0, 0, surfaceWidth_, surfaceHeight_);
+    bindTarget();
     glClearColor(0, 0, 0, 1);
 }
 
+void Game::bindTarget() {
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer_);
+    GlState::viewport(0, 0, surfaceWidth_, surfaceHeight_);
+}
+
+void Game::setTargetFramebuffer(GLuint framebuffer) {
+    targetFramebuffer_ = framebuffer;
+}
+
 void Game::update() {
     glm::vec4 lightFrustum[6];
     calcConeFrustum(light_.pos(), light_.dir(), light_.getTanPhi(),
         light_.length(), lightFrustum);
 
-    lightshaft_.bind();
-    int loc = lightshaft_.getUniformLocation("u_ClipPlanes[0]");
+    auto &lightshaft = getLightshaft();
+    lightshaft.bind();
     for (int i = 0; i < 6; i++) {
-        lightshaft_.setUniformVec4(loc + i, glm::value_ptr(lightFrustum[i]));
+        lightshaft.setUniformVec4(clipPlanesLocation_ + i, glm::value_ptr(lightFrustum[i]));
     } 
     glsl::Program::unbind();
+
+    if (!simulation_) {
+        auto steps = fixedTimestep_ ? clock_.advance(clock_.getStep()) : clock_.advance();
+        for (int i = 0; i < steps; i++) {
+            previous_ = latest_;
+            solver_.advance(balls_, simulationStep);
+            auto step = clock_.getSteps() - steps + i + 1;
+            latest_.capture(balls_, step, step * clock_.getStep() + clock_.getDroppedTime());
+        }
+        alpha_ = clock_.getAlpha();
+        return;
+    }
+
+    simulation_->poll(previous_, latest_);
+    alpha_ = simulation_->getAlpha();
+}
+
+void Game::startSimulationThread() {
+    latest_.capture(balls_, 0, 0);
+    previous_ = latest_;
+    simulation_.reset(new SimulationThread(balls_, simulationStep));
 }
 
 void Game::render() {
-    update();
+    if (reloader_) {
+        reloader_->update();
+    }
+    profiler_.beginFrame();
+    GlState::beginFrame();
+    {
+        auto scope = profiler_.scope("frame");
+        {
+            auto updateScope = profiler_.scope("update");
+            update();
+            frameUniforms_.update(frustum_, light_);
+
+            // the shadow map sees what the light projection sees
+            Plane lightPlanes[6];
+            Frustum::extractPlanes(light_.computeProjViewMat(), lightPlanes);
+            ball_.update(previous_, latest_, alpha_, frustum_, lightPlanes);
+            profiler_.count("balls culled by camera", ball_.getCameraCulled());
+            profiler_.count("balls culled by light", ball_.getLightCulled());
+            profiler_.count("instance buffer stalls", ball_.getInstanceStalls());
+        }
+        if (depthPrepass_) {
+            renderSceneDepth();
+        }
+        renderShadowMap();
 
-    ball_.update(frustum_, light_);
-    renderSceneDepth();
-    renderShadowMap();
+        // render main scene
+        if (!depthPrepass_) {
+            GlState::bindFramebuffer(GL_FRAMEBUFFER, sceneDepthBuffer_);
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // render main scene
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    table_.render(frustum_, light_, colorMap_);
-    ball_.render();
+        {
+            auto tableScope = profiler_.scope("table");
+            table_.render(colorMap_);
+        }
+        {
+            auto ballScope = profiler_.scope("balls");
+            ball_.render();
+        }
 
-    renderLightshaft();
+        if (!depthPrepass_) {
+            resolveScene();
+        }
+        renderLightshaft();
+
+        auto calls = GlState::getCounters();
+        profiler_.count("gl state calls issued", calls.issued);
+        profiler_.count("gl state calls skipped", calls.skipped);
+    }
+    GlState::endFrame();
+    profiler_.endFrame();
 }
 
 void Game::resize(int surfaceWidth, int surfaceHeight) {
@@ -340,6 +672,8 @@ void Game::resize(int surfaceWidth, int surfaceHeight) {
     sceneDepthMap_ = createDepthMap<GL_TEXTURE_RECTANGLE>(GL_DEPTH24_STENCIL8_EXT, GL_DEPTH_STENCIL_EXT, GL_UNSIGNED_INT_24_8_EXT, surfaceWidth, surfaceHeight);
     sceneRenderbuffer_ = createSceneRenderbuffer(surfaceWidth, surfaceHeight);
     sceneDepthBuffer_ = createFramebuffer(0, sceneDepthMap_, sceneDepthMap_, sceneRenderbuffer_);
+    createShaftTarget();
+    GlState::forget();
 }
 
 void Game::mouseDown(float x, float y) {
@@ -389,43 +723,102 @@ void Game::updateProjection() {
 }
 
 void Game::keyAction(int key, bool pressed) {
+    if (key == GLFW_KEY_SPACE) {
+        Shot shot = { 0, glm::vec2(0, cueSpeed), glm::vec3(0) };
+        if (pressed && simulation_) {
+            simulation_->strike(shot);
+        } else if (pressed && !balls_.isMoving()) {
+            balls_.strike(shot.ball, shot.velocity, shot.spin);
+        }
+        return;
+    }
+    if (key == GLFW_KEY_P) {
+        if (pressed) {
+            std::ostringstream report;
+            profiler_.report(report);
+            LOG(INFO) << "frame profile:\n" << report.str();
+            try {
+                profiler_.dumpTrace(exePath_ + "trace.json");
+            } catch (const std::exception &e) {
+                LOG(ERROR) << e.what();
+            }
+        }
+        return;
+    }
     ball_.setLineFill(pressed);
 }
 
 void Game::renderSceneDepth() {
-    sceneDepthBuffer_.bind<GL_FRAMEBUFFER>();
+    auto scope = profiler_.scope("sceneDepth");
+
+    GlState::bindFramebuffer(GL_FRAMEBUFFER, sceneDepthBuffer_);
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
     glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    table_.renderDepth(frustum_);
+    GlState::colorMask(false);
+    table_.renderDepth();
     ball_.renderDepth();
     glFlush();
 
-    glBindVertexArray(0);
-    Framebuffer::unbind<GL_FRAMEBUFFER>();
-    glDrawBuffer(GL_BACK);
-    glReadBuffer(GL_BACK);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    bindTarget();
+    GlState::colorMask(true);
+}
+
+void Game::resolveScene() {
+    auto scope = profiler_.scope("resolveScene");
+
+    // the light shafts sample the depth, so it stays where it is
+    GlState::bindFramebuffer(GL_READ_FRAMEBUFFER, sceneDepthBuffer_);
+    GlState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer_);
+    glBlitFramebuffer(0, 0, surfaceWidth_, surfaceHeight_, 0, 0, surfaceWidth_, surfaceHeight_,
+        GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    bindTarget();
 }
 
 void Game::renderLightshaft() {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    auto scope = profiler_.scope("lightshaft");
+
+    auto march = shaftTechnique_ == ShaftTechnique::RayMarch;
+    auto temporal = march && temporalShafts_;
+    if (temporal) {
+        // no reprojection, any other view of the cone starts over
+        auto lightMat = light_.computeProjViewMat();
+        if (frustum_.getViewProj() != historyViewProj_ || lightMat != historyLight_) {
+            historyValid_ = false;
+        }
+        historyViewProj_ = frustum_.getViewProj();
+        historyLight_ = lightMat;
+    }
+
+    auto offscreen = rendersShaftsOffscreen();
+    if (offscreen) {
+        GlState::bindFramebuffer(GL_FRAMEBUFFER, shaftBuffer_);
+        GlState::viewport(0, 0, getShaftSize(surfaceWidth_, shaftDivisor_), getShaftSize(surfaceHeight_, shaftDivisor_));
+        if (!temporal || !historyValid_) {
+            glClearColor(0, 0, 0, 0);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glClearColor(0, 0, 0, 1);
+        }
+    }
+
+    // without the prepass the target has no scene depth, the shader fades
+    // shafts behind the scene against the sampled depth on its own
+    GlState::setEnabled(GL_DEPTH_TEST, depthPrepass_ && !offscreen && !march);
+    GlState::setEnabled(GL_BLEND, true);
+    GlState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // render dust here.
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    GlState::blendFunc(GL_SRC_ALPHA, GL_ONE);
 
-    glDisable(GL_CULL_FACE);
+    GlState::setEnabled(GL_CULL_FACE, false);
 
     auto a = light_.pos();
     auto s = a + light_.dir() * light_.length();
 
     const auto &view = frustum_.getView();
     auto inverseView = glm::inverse(view);
-    auto inverseRotView = glm::inverse(glm::mat3(view));
 
     auto camPos = inverseView * glm::vec4(0, 0, 0, 1);
     camPos /= camPos.w;
@@ -447,77 +840,161 @@ void Game::renderLightshaft() {
     float minf, maxf;
     detectMinMax(a, b, c, af, bf, cf, &min, &minf, &maxf);
 
-    auto eyeLightPos = view * glm::vec4(light_.pos(), 1.0f);
-    eyeLightPos /= eyeLightPos.w;
+    GlState::bindTexture(0, GL_TEXTURE_2D, colorMap_);
+    GlState::bindTexture(1, GL_TEXTURE_2D, cookie_);
+    GlState::bindTexture(2, GL_TEXTURE_RECTANGLE, sceneDepthMap_);
+
+    if (march) {
+        marchLightshaft(std::fabs(maxf - minf));
+    } else {
+        auto &lightshaft = getLightshaft();
+        lightshaft.bind();
+        lightshaft.setUniformVec3(coneMinLocation_, glm::value_ptr(min));
+        lightshaft.setUniformFloat(coneDepthLocation_, std::fabs(maxf - minf));
+        lightshaft.setUniformFloat(depthScaleLocation_, static_cast<float>(shaftDivisor_));
+
+        auto slices = lighshaftGeometry_.getPlanes();
+        if (adaptiveSlices_) {
+            auto p1 = glm::normalize(p);
+            const glm::vec3 points[] = { a, b, c, s - p1 * r, s + p1 * r };
+            slices = computeShaftSlices(frustum_.getViewProj(), points, std::fabs(maxf - minf),
+                std::max(2 * r, light_.length()), surfaceWidth_, surfaceHeight_, slices);
+        }
+        // the geometry rounds up to one of its levels, weigh by what is drawn
+        slices = lighshaftGeometry_.getLevelPlanes(slices);
+        lightshaft.setUniformFloat(sliceWeightLocation_,
+            static_cast<float>(LightShaftGeometry::DEFAULT_PLANES) / slices);
+        profiler_.count("shaft slices", slices);
+
+        for (int i = 0; i < 6; i++) {
+            GlState::setEnabled(GL_CLIP_DISTANCE0 + i, true);
+        }
 
-    auto depthBiasProjViewMat = utils::biasMatrix * light_.computeProjViewMat();
+        GlState::setEnabled(GL_CULL_FACE, false);
 
-    colorMap_.bind<GL_TEXTURE_2D>();
-    glActiveTexture(GL_TEXTURE1);
-    cookie_.bind<GL_TEXTURE_2D>();
-    glActiveTexture(GL_TEXTURE2);
-    sceneDepthMap_.bind<GL_TEXTURE_RECTANGLE>();
-    glActiveTexture(GL_TEXTURE0);
+        lighshaftGeometry_.render(slices);
 
-    lightshaft_.bind();
-    lightshaft_.setUniformMat4("u_DepthBiasMat", false, glm::value_ptr(depthBiasProjViewMat));
-    
-    lightshaft_.setUniformMat3("u_InverseViewRotMat", false, glm::value_ptr(inverseRotView));
-    lightshaft_.setUniformMat4("u_ModelViewMat", false, glm::value_ptr(view));
-    lightshaft_.setUniformMat4("u_ProjectionMat", false, frustum_.getProjPtr());
-
-    lightshaft_.setUniformVec3("u_ConePos", glm::value_ptr(eyeLightPos));
-    lightshaft_.setUniformInt("u_ShadowMap", 0);
-    lightshaft_.setUniformInt("u_Texture", 1);
-    lightshaft_.setUniformInt("u_Depth", 2);
-    lightshaft_.setUniformFloat("u_ConeHeight", light_.length());
-    lightshaft_.setUniformFloat("u_TanPhi", light_.getTanPhi());
-    lightshaft_.setUniformVec3("u_ConeMin", glm::value_ptr(min));
-    lightshaft_.setUniformFloat("u_ConeDepth", std::fabs(maxf - minf));
-    
-    lightshaft_.setUniformFloat("u_NearPlane", frustum_.getNear());
-    lightshaft_.setUniformFloat("u_FarPlane", frustum_.getFar());
+        for (int i = 0; i < 6; i++) {
+            GlState::setEnabled(GL_CLIP_DISTANCE0 + i, false);
+        }
+    }
 
-    light_.bind(lightshaft_, frustum_);
+    if (offscreen) {
+        upsampleLightshaft();
+    }
+    GlState::setEnabled(GL_BLEND, false);
+    GlState::setEnabled(GL_DEPTH_TEST, true);
+}
 
-    for (int i = 0; i < 6; i++) {
-        glEnable(GL_CLIP_DISTANCE0 + i);
+void Game::marchLightshaft(float coneDepth) {
+    auto scope = profiler_.scope("marchLightshaft");
+
+    // screen box of the cone as far as the shader marches it, the base
+    // circle lies inside an octagon around it
+    glm::vec3 x, y;
+    calcConeXY(light_.dir(), &x, &y);
+    auto coneHeight = light_.length() * 1.1f;
+    auto base = light_.pos() + light_.dir() * coneHeight;
+    auto r = coneHeight * light_.getTanPhi() / std::cos(static_cast<float>(M_PI) / 8);
+    glm::vec3 points[9];
+    points[0] = light_.pos();
+    for (int i = 0; i < 8; i++) {
+        auto angle = i * static_cast<float>(M_PI) / 4;
+        points[i + 1] = base + (x * std::cos(angle) + y * std::sin(angle)) * r;
+    }
+    glm::vec2 lower, upper;
+    projectBounds(frustum_.getViewProj(), points, &lower, &upper);
+
+    auto offscreen = rendersShaftsOffscreen();
+    auto width = offscreen ? getShaftSize(surfaceWidth_, shaftDivisor_) : surfaceWidth_;
+    auto height = offscreen ? getShaftSize(surfaceHeight_, shaftDivisor_) : surfaceHeight_;
+    auto left = static_cast<int>(std::floor((lower.x + 1) / 2 * width));
+    auto bottom = static_cast<int>(std::floor((lower.y + 1) / 2 * height));
+    auto right = static_cast<int>(std::ceil((upper.x + 1) / 2 * width));
+    auto top = static_cast<int>(std::ceil((upper.y + 1) / 2 * height));
+    profiler_.count("shaft march pixels", std::max(right - left, 0) * std::max(top - bottom, 0));
+    if (right <= left || top <= bottom) {
+        return;
+    }
+    GlState::setEnabled(GL_SCISSOR_TEST, true);
+    GlState::scissor(left, bottom, right - left, top - bottom);
+
+    // the history keeps a running average, anything else adds up
+    auto temporal = temporalShafts_ && offscreen;
+    if (temporal && historyValid_) {
+        GlState::blendColor(0, 0, 0, TEMPORAL_WEIGHT);
+        GlState::blendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+    } else {
+        GlState::blendFunc(GL_ONE, GL_ONE);
     }
 
-    glDisable(GL_CULL_FACE);
+    auto &march = march_.get(getLightshaftFlags());
+    march.bind();
+    march.setUniformFloat(marchDepthScaleLocation_, static_cast<float>(shaftDivisor_));
+    march.setUniformFloat(marchConeDepthLocation_, coneDepth);
+    march.setUniformInt(marchStepsLocation_, marchSteps_);
+    // golden ratio steps spread the offsets of any run of frames evenly
+    if (temporal) {
+        marchJitter_ = std::fmod(marchJitter_ + 0.618034f, 1.0f);
+    }
+    march.setUniformFloat(marchJitterLocation_, temporal ? marchJitter_ : 0.0f);
+    GlState::bindVertexArray(quadVao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 
-    lighshaftGeometry_.render();
+    GlState::setEnabled(GL_SCISSOR_TEST, false);
+    if (temporal) {
+        historyValid_ = true;
+    }
+}
 
-    glsl::Program::unbind();
+void Game::upsampleLightshaft() {
+    auto scope = profiler_.scope("upsampleLightshaft");
 
-    for (int i = 0; i < 6; i++) {
-        glDisable(GL_CLIP_PLANE0 + i);
-    }
-    glDisable(GL_BLEND);
+    // the shaft texture holds what blending would have added to the target
+    bindTarget();
+    GlState::blendFunc(GL_ONE, GL_ONE);
+    GlState::bindTexture(0, GL_TEXTURE_2D, shaftColor_);
+    GlState::bindTexture(2, GL_TEXTURE_RECTANGLE, sceneDepthMap_);
+
+    auto &upsample = upsample_.get(getLightshaftFlags());
+    upsample.bind();
+    upsample.setUniformFloat(divisorLocation_, static_cast<float>(shaftDivisor_));
+    GlState::bindVertexArray(quadVao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
-LightShaftGeometry::LightShaftGeometry() {
+LightShaftGeometry::LightShaftGeometry(int planes) : planes_(planes) {
     std::vector<glm::vec3> vertices;
     std::vector<GLushort> indices;
     GLushort index = 0;
-    for (int i = SHAFT_PLANES_COUNT - 1; i >= 0; i--) {
-        auto slice = static_cast<float>(i) / (SHAFT_PLANES_COUNT - 1);
-        vertices.push_back(glm::vec3(-1, -1, slice));
-        vertices.push_back(glm::vec3( 1, -1, slice));
-        vertices.push_back(glm::vec3( 1,  1, slice));
-        vertices.push_back(glm::vec3(-1,  1, slice));
-
-        indices.push_back(index);
-        indices.push_back(index + 1);
-        indices.push_back(index + 2);
-
-        indices.push_back(index);
-        indices.push_back(index + 2);
-        indices.push_back(index + 3);
+    for (int levelPlanes = planes_; ; levelPlanes /= 2) {
+        Level level = { levelPlanes, 0, indices.size() * sizeof(GLushort) };
+        for (int i = levelPlanes - 1; i >= 0; i--) {
+            auto slice = static_cast<float>(i) / (levelPlanes - 1);
+            vertices.push_back(glm::vec3(-1, -1, slice));
+            vertices.push_back(glm::vec3( 1, -1, slice));
+            vertices.push_back(glm::vec3( 1,  1, slice));
+            vertices.push_back(glm::vec3(-1,  1, slice));
+
+            indices.push_back(index);
+            indices.push_back(index + 1);
+            indices.push_back(index + 2);
+
+            indices.push_back(index);
+            indices.push_back(index + 2);
+            indices.push_back(index + 3);
         
-        index += 4;
+            index += 4;
+        }
+        level.count = static_cast<GLsizei>(indices.size() - level.offset / sizeof(GLushort));
+        levels_.push_back(level);
+        if (levelPlanes / 2 < MIN_PLANES) {
+            break;
+        }
+    }
+    if (vertices.size() > 0xffff) {
+        throw std::runtime_error("Too many light shaft slices");
     }
-    size_ = indices.size();
     
     glBindVertexArray(vao_);
     vbo_.bind<GL_ARRAY_BUFFER>();
@@ -533,10 +1010,18 @@ LightShaftGeometry::LightShaftGeometry() {
     VertexBuffer::unbind<GL_ELEMENT_ARRAY_BUFFER>();
 }
 
-void LightShaftGeometry::render() const {
-    glBindVertexArray(vao_);
-    glDrawElements(GL_TRIANGLES, size_, GL_UNSIGNED_SHORT, nullptr);
-    glBindVertexArray(0);
+const LightShaftGeometry::Level &LightShaftGeometry::findLevel(int planes) const {
+    auto level = levels_.rbegin();
+    while (level->planes < planes && level + 1 != levels_.rend()) {
+        ++level;
+    }
+    return *level;
+}
+
+void LightShaftGeometry::render(int planes) const {
+    const auto &level = findLevel(planes);
+    GlState::bindVertexArray(vao_);
+    glDrawElements(GL_TRIANGLES, level.count, GL_UNSIGNED_SHORT, reinterpret_cast<const void *>(level.offset));
 }
 
-}
\ No newline at end of file
+}
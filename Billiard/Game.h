@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <memory>
+#include <vector>
 #include <GL\glew.h>
 #include <GL\GL.h>
 #include <glm\glm.hpp>
@@ -11,33 +13,73 @@
 #include "Texture.h"
 #include "Framebuffer.h"
 #include "ConeLight.h"
+#include "FrameUniforms.h"
 
 #include "Table.h"
 #include "Ball.h"
 #include "Particles.h"
+#include "BallSystem.h"
+#include "EventSolver.h"
+#include "Profiler.h"
+#include "BallSnapshot.h"
+#include "SimulationThread.h"
+#include "Clock.h"
+#include "AssetLoader.h"
+#include "ShaderReloader.h"
+#include "ProgramLibrary.h"
 
 namespace billiard {
 
+/*
+    View aligned slices of the light cone. Besides all the planes it holds
+    every coarser level down to MIN_PLANES, halving each time, as ranges of
+    the same index buffer, so a cone far away is drawn with fewer slices.
+*/
 class LightShaftGeometry {
-    static const int SHAFT_PLANES_COUNT = 32;
+    struct Level {
+        int planes;
+        GLsizei count;
+        size_t offset; // bytes into the index buffer
+    };
 
     VertexArray vao_;
     VertexBuffer vbo_;
     VertexBuffer indices_;
 
-    GLsizei size_;
+    int planes_;
+    std::vector<Level> levels_; // most planes first
+
+    const Level &findLevel(int planes) const;
 public:
-    LightShaftGeometry();
-    void render() const;
+    static const int DEFAULT_PLANES = 32;
+    static const int MIN_PLANES = 4;
+
+    explicit LightShaftGeometry(int planes = DEFAULT_PLANES);
+    int getPlanes() const { return planes_; }
+
+    // slices of the coarsest level with at least planes of them.
+    int getLevelPlanes(int planes) const { return findLevel(planes).planes; }
+    void render(int planes) const;
+};
+
+enum class ShaftTechnique {
+    Slices,  // blended view aligned planes, bounded by the cone's clip planes
+    RayMarch // one screen pass marching the cone, scissored to its bounds
 };
 
 class Game {
     const std::string exePath_;
 
+    // startup only, released at the end of the constructor
+    std::unique_ptr<AssetLoader> assets_;
+
     // window size
     int surfaceWidth_;
     int surfaceHeight_;
 
+    // where the final image goes, 0 is the window.
+    GLuint targetFramebuffer_;
+
     bool mouseDown_;
     glm::vec2 mousePos_;
 
@@ -46,12 +88,34 @@ class Game {
     float cameraDistance_;
     Frustum frustum_;
 
+    // program templates and the variants built from them, shared by everything below
+    ProgramLibrary programs_;
+
     // scene objects
     Table table_;
     Ball ball_;
     ConeLight light_;
-
-    // scene depth from camera view
+    FrameUniforms frameUniforms_;
+
+    // simulation, stepped in render unless it runs on its own thread
+    BallSystem balls_;
+    EventSolver solver_;
+    Clock clock_;
+    bool fixedTimestep_;
+    std::unique_ptr<SimulationThread> simulation_;
+
+    // frames show balls between the two latest steps
+    BallSnapshot previous_;
+    BallSnapshot latest_;
+    float alpha_;
+
+    Profiler profiler_;
+
+    // scene depth from camera view. The main pass renders into
+    // sceneDepthBuffer_ and is copied to the target, unless the depth
+    // prepass fills it with linear depth first.
+    bool depthPrepass_;
+    bool adaptiveSlices_;
     Texture sceneDepthMap_;
     Renderbuffer sceneRenderbuffer_;
     Framebuffer sceneDepthBuffer_;
@@ -65,17 +129,47 @@ class Game {
     Texture colorMap2_;
     Framebuffer shadowBuffer2_;
 
-    glsl::Program blurVertically_;
-    glsl::Program blurHorizontally_;
+    ProgramVariants &blur_;
 
     // lightshaft specific
-    glsl::Program lightshaft_;
-    const LightShaftGeometry lighshaftGeometry_;
+    ProgramVariants &lightshafts_;
+    int coneMinLocation_;
+    int coneDepthLocation_;
+    int clipPlanesLocation_;
+    LightShaftGeometry lighshaftGeometry_;
+
+    // shafts drawn at 1 / shaftDivisor_ of the surface size are upsampled
+    // into the target, at 1 they go there directly
+    int shaftDivisor_;
+    Texture shaftColor_;
+    Framebuffer shaftBuffer_;
+    ProgramVariants &upsample_;
+    int divisorLocation_;
+    int depthScaleLocation_;
+    int sliceWeightLocation_;
     const Texture cookie_;
 
+    // ray marching, the temporal path keeps a running average of jittered
+    // frames in shaftColor_ until the camera or the light moves
+    ShaftTechnique shaftTechnique_;
+    ProgramVariants &march_;
+    int marchDepthScaleLocation_;
+    int marchConeDepthLocation_;
+    int marchStepsLocation_;
+    int marchJitterLocation_;
+    int marchSteps_;
+    bool temporalShafts_;
+    bool historyValid_;
+    glm::mat4 historyViewProj_;
+    glm::mat4 historyLight_;
+    float marchJitter_;
+
     VertexBuffer quad_;
     const VertexArray quadVao_;
 
+    // set by enableShaderReload
+    std::unique_ptr<ShaderReloader> reloader_;
+
     void updateProjection();
     void updateModelview();
 
@@ -83,6 +177,23 @@ class Game {
     void renderSceneDepth();
     void renderLightshaft();
 
+    // reads linear depth from the prepass or perspective depth from the main pass
+    unsigned getLightshaftFlags() const;
+    glsl::Program &getLightshaft();
+    // samplers and uniforms that never change, again after every reload
+    void setupLightshaft(glsl::Program &program, unsigned flags);
+    void resolveScene();
+    void createShaftTarget();
+    bool rendersShaftsOffscreen() const;
+    // like setupLightshaft, for the upsample and the ray marched shafts
+    void setupUpsample(glsl::Program &program, unsigned flags);
+    void setupMarch(glsl::Program &program, unsigned flags);
+    // again for the variants of the current depth source and technique
+    void setupShaftPrograms();
+    void marchLightshaft(float coneDepth);
+    void upsampleLightshaft();
+
+    void bindTarget();
     void update();
 public:
     Game(int surfaceWidth, int surfaceHeight);
@@ -91,12 +202,49 @@ public:
     void render();
     void resize(int surfaceWidth, int surfaceHeight);
 
+    // renders into an offscreen framebuffer of the surface size instead.
+    void setTargetFramebuffer(GLuint framebuffer);
+
+    // moves the simulation to its own thread.
+    void startSimulationThread();
+
+    /*
+        Light shafts are the most fill rate hungry pass, slices is how many
+        planes the light cone is drawn with at most and divisor how many times
+        smaller than the surface they are rendered, 1, 2 or 4. Throws on
+        values out of range.
+    */
+    void setLightshaftQuality(int slices, int divisor);
+
+    // fewer slices for a cone covering less of the screen, on by default.
+    void setAdaptiveShaftSlices(bool value) { adaptiveSlices_ = value; }
+
+    /*
+        Slices by default. Ray marching takes steps samples along each ray
+        through the cone, temporal averages frames with different sample
+        offsets, which needs fewer steps while nothing moves. Throws when
+        steps is less than 1.
+    */
+    void setShaftTechnique(ShaftTechnique technique, int steps, bool temporal);
+
+    // renders table and balls once more for the light shafts' depth, the old way.
+    void setDepthPrepass(bool value);
+
+    // rebuilds programs whose shaders are edited while running.
+    void enableShaderReload();
+
+    // exactly one simulation step per frame whatever the frame takes, 
+    // for reproducible offscreen runs.
+    void setFixedTimestep(bool value) { fixedTimestep_ = value; }
+
     void mouseMoved(float x, float y);
     void mouseDown(float x, float y);
     void mouseUp();
     void mouseScrolled(float y);
 
     void keyAction(int key, bool pressed);
+
+    Profiler &getProfiler() { return profiler_; }
 };
 
 }
\ No newline at end of file
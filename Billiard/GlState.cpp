@@ -0,0 +1,231 @@
+#include "StdAfx.h"
+#include "GlState.h"
+
+#include <stdexcept>
+
+namespace billiard {
+
+namespace {
+    // matches no real name or enum, so the next call is always issued
+    const GLuint UNKNOWN = ~0u;
+    const GLboolean UNKNOWN_BOOLEAN = 0xff;
+}
+
+GlState::State GlState::forgotten() {
+    State state;
+    state.program = UNKNOWN;
+    state.vertexArray = UNKNOWN;
+    state.drawFramebuffer = UNKNOWN;
+    state.readFramebuffer = UNKNOWN;
+    state.activeUnit = UNKNOWN;
+    for (auto &unit : state.units) {
+        unit.texture2D = UNKNOWN;
+        unit.rectangle = UNKNOWN;
+        unit.array = UNKNOWN;
+    }
+    state.cullFace = UNKNOWN;
+    state.polygonMode = UNKNOWN;
+    state.blendSrc = UNKNOWN;
+    state.blendDst = UNKNOWN;
+    state.depthMask = UNKNOWN_BOOLEAN;
+    state.colorMask = UNKNOWN_BOOLEAN;
+    for (auto &value : state.viewport) {
+        value = -1;
+    }
+    for (auto &value : state.scissor) {
+        value = -1;
+    }
+    // out of the [0, 1] GL clamps the color to
+    for (auto &value : state.blendColor) {
+        value = -1;
+    }
+    return state;
+}
+
+GlState::State GlState::sState = GlState::forgotten();
+GlState::Counters GlState::sCounters = { 0, 0 };
+
+void GlState::beginFrame() {
+    forget();
+    sCounters.issued = 0;
+    sCounters.skipped = 0;
+}
+
+void GlState::endFrame() {
+    // texture setup outside frames binds on whatever unit is active
+    if (change(sState.activeUnit, 0u)) {
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+void GlState::forget() {
+    sState = forgotten();
+}
+
+void GlState::programDeleted(GLuint program) {
+    if (sState.program == program) {
+        sState.program = UNKNOWN;
+    }
+}
+
+void GlState::useProgram(GLuint program) {
+    if (change(sState.program, program)) {
+        glUseProgram(program);
+    }
+}
+
+void GlState::bindVertexArray(GLuint vertexArray) {
+    if (change(sState.vertexArray, vertexArray)) {
+        glBindVertexArray(vertexArray);
+    }
+}
+
+GLuint &GlState::boundTexture(GLuint unit, GLenum target) {
+    if (unit >= TEXTURE_UNITS) {
+        throw std::runtime_error("Texture unit out of range");
+    }
+    switch (target) {
+    case GL_TEXTURE_2D:
+        return sState.units[unit].texture2D;
+    case GL_TEXTURE_RECTANGLE:
+        return sState.units[unit].rectangle;
+    case GL_TEXTURE_2D_ARRAY:
+        return sState.units[unit].array;
+    default:
+        throw std::runtime_error("Unsupported texture target");
+    }
+}
+
+void GlState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    auto &bound = boundTexture(unit, target);
+    if (bound == texture) {
+        sCounters.skipped++;
+        return;
+    }
+    if (change(sState.activeUnit, unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    change(bound, texture);
+    glBindTexture(target, texture);
+}
+
+void GlState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+    switch (target) {
+    case GL_FRAMEBUFFER:
+        if (sState.drawFramebuffer == framebuffer && sState.readFramebuffer == framebuffer) {
+            sCounters.skipped++;
+            return;
+        }
+        sState.drawFramebuffer = framebuffer;
+        sState.readFramebuffer = framebuffer;
+        sCounters.issued++;
+        break;
+    case GL_DRAW_FRAMEBUFFER:
+        if (!change(sState.drawFramebuffer, framebuffer)) {
+            return;
+        }
+        break;
+    case GL_READ_FRAMEBUFFER:
+        if (!change(sState.readFramebuffer, framebuffer)) {
+            return;
+        }
+        break;
+    default:
+        throw std::runtime_error("Unsupported framebuffer target");
+    }
+    glBindFramebuffer(target, framebuffer);
+}
+
+void GlState::setEnabled(GLenum capability, bool enabled) {
+    auto found = sState.enabled.find(capability);
+    if (found != sState.enabled.end() && found->second == enabled) {
+        sCounters.skipped++;
+        return;
+    }
+    sState.enabled[capability] = enabled;
+    sCounters.issued++;
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void GlState::cullFace(GLenum face) {
+    if (change(sState.cullFace, face)) {
+        glCullFace(face);
+    }
+}
+
+void GlState::polygonMode(GLenum mode) {
+    if (change(sState.polygonMode, mode)) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void GlState::blendFunc(GLenum src, GLenum dst) {
+    if (sState.blendSrc == src && sState.blendDst == dst) {
+        sCounters.skipped++;
+        return;
+    }
+    sState.blendSrc = src;
+    sState.blendDst = dst;
+    sCounters.issued++;
+    glBlendFunc(src, dst);
+}
+
+void GlState::blendColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    auto &current = sState.blendColor;
+    if (current[0] == red && current[1] == green && current[2] == blue && current[3] == alpha) {
+        sCounters.skipped++;
+        return;
+    }
+    current[0] = red;
+    current[1] = green;
+    current[2] = blue;
+    current[3] = alpha;
+    sCounters.issued++;
+    glBlendColor(red, green, blue, alpha);
+}
+
+void GlState::depthMask(bool write) {
+    if (change(sState.depthMask, static_cast<GLboolean>(write))) {
+        glDepthMask(write);
+    }
+}
+
+void GlState::colorMask(bool write) {
+    if (change(sState.colorMask, static_cast<GLboolean>(write))) {
+        glColorMask(write, write, write, write);
+    }
+}
+
+void GlState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    auto &current = sState.viewport;
+    if (current[0] == x && current[1] == y && current[2] == width && current[3] == height) {
+        sCounters.skipped++;
+        return;
+    }
+    current[0] = x;
+    current[1] = y;
+    current[2] = width;
+    current[3] = height;
+    sCounters.issued++;
+    glViewport(x, y, width, height);
+}
+
+void GlState::scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    auto &current = sState.scissor;
+    if (current[0] == x && current[1] == y && current[2] == width && current[3] == height) {
+        sCounters.skipped++;
+        return;
+    }
+    current[0] = x;
+    current[1] = y;
+    current[2] = width;
+    current[3] = height;
+    sCounters.issued++;
+    glScissor(x, y, width, height);
+}
+
+}
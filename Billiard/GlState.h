@@ -0,0 +1,101 @@
+#pragma once
+
+#include <unordered_map>
+#include <GL\glew.h>
+
+namespace billiard {
+
+/**
+* Shadows the GL state the render passes change and drops calls that would
+* set what is already set. Only calls going through here are seen, so
+* beginFrame() forgets everything and the first call of each kind in a
+* frame always reaches GL, whatever loading, resizing or readback did
+* between frames; code that binds things directly calls forget() after.
+* endFrame() leaves texture unit 0 active for such code. Everything lives
+* on the GL thread.
+*/
+class GlState
+{
+public:
+    static const int TEXTURE_UNITS = 8;
+
+    struct Counters {
+        int issued;
+        int skipped;
+    };
+
+private:
+    struct Unit {
+        GLuint texture2D;
+        GLuint rectangle;
+        GLuint array;
+    };
+
+    struct State {
+        GLuint program;
+        GLuint vertexArray;
+        GLuint drawFramebuffer;
+        GLuint readFramebuffer;
+        GLuint activeUnit;
+        Unit units[TEXTURE_UNITS];
+        std::unordered_map<GLenum, bool> enabled;
+        GLenum cullFace;
+        GLenum polygonMode;
+        GLenum blendSrc;
+        GLenum blendDst;
+        GLboolean depthMask;
+        GLboolean colorMask;
+        GLint viewport[4];
+        GLint scissor[4];
+        GLfloat blendColor[4];
+    };
+
+    static State sState;
+    static State forgotten();
+    static Counters sCounters;
+
+    // true when value differs and was stored, so the caller issues the call
+    template <typename T>
+    static bool change(T &current, T value) {
+        if (current == value) {
+            sCounters.skipped++;
+            return false;
+        }
+        current = value;
+        sCounters.issued++;
+        return true;
+    }
+
+    static GLuint &boundTexture(GLuint unit, GLenum target);
+
+public:
+    // forgets the shadowed state and starts counting the frame's calls.
+    static void beginFrame();
+    static void endFrame();
+
+    // after GL calls made around this class, so the next ones reach GL.
+    static void forget();
+
+    static Counters getCounters() { return sCounters; }
+
+    // the GL object may be gone, its name can come back for another object.
+    static void programDeleted(GLuint program);
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertexArray);
+    static void bindTexture(GLuint unit, GLenum target, GLuint texture);
+    // GL_FRAMEBUFFER binds both the draw and read framebuffer.
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+    static void setEnabled(GLenum capability, bool enabled);
+    static void cullFace(GLenum face);
+    static void polygonMode(GLenum mode); // front and back
+    static void blendFunc(GLenum src, GLenum dst);
+    static void blendColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+    static void depthMask(bool write);
+    static void colorMask(bool write); // all channels
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    static void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+};
+
+}
@@ -9,13 +9,47 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <chrono>
+#include <cstring>
 #include "utils.h"
+#include "FrameUniforms.h"
+#include "ProgramCache.h"
 
 #include <glog/logging.h>
 using namespace google;
 
 namespace glsl {
 
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    Program::CompileStats stats = { 0, 0, 0, 0 };
+    Clock::time_point firstSubmit;
+
+    double elapsedMs(Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    // the enum is all the extension adds, drivers use as many threads as they like by default
+    const GLenum COMPLETION_STATUS = 0x91B1;
+
+    bool hasParallelCompile() {
+        static const bool supported = []() {
+            GLint count = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+            for (GLint i = 0; i < count; i++) {
+                auto name = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+                if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0
+                        || std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }();
+        return supported;
+    }
+}
+
 void logShaderInfo(GLuint shader) {
     GLint size;
     glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &size);
@@ -35,13 +69,15 @@ std::vector<std::string> createSources(T&& defines, V&& source) {
     std::vector<std::string> result;
     result.push_back("#version 410 core\n");
     result.push_back(std::forward<T>(defines));
+    result.push_back(billiard::FrameUniforms::SOURCE);
     result.push_back(std::forward<V>(source));
     return result;
 }
    
-bool checkCompileStatus(GLuint shader) {
+bool Shader::checkCompileStatus() const {
     GLint compileStatus;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus);
+    logShaderInfo(shader);
     if (compileStatus == GL_FALSE) {
         // some error
         LOG(ERROR) <<  "Error compiling shader";
@@ -74,8 +110,8 @@ std::vector<Uniform> loadAttributeLocations(GLuint program) {
     return result;
 }
 
-std::vector<Uniform> loadUniformLocations(GLuint program) {
-    std::vector<Uniform> result;
+std::unordered_map<std::string, int> loadUniformLocations(GLuint program) {
+    std::unordered_map<std::string, int> result;
 
     GLint uniformsCount;
     glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformsCount);
@@ -90,16 +126,27 @@ std::vector<Uniform> loadUniformLocations(GLuint program) {
         GLenum type;
 
         glGetActiveUniform(program, i, maxLength,  &len, &size, &type, name.data());
-        Uniform p(std::string(name.begin(), name.begin() + len), 
-                    glGetUniformLocation(program, name.data()));
-        result.push_back(p);
+        auto location = glGetUniformLocation(program, name.data());
+        if (location < 0) {
+            continue; // member of a uniform block
+        }
+        std::string uniform(name.begin(), name.begin() + len);
+        result[uniform] = location;
 
-        LOG(INFO) << "Uniform(" << p.name() << ") located at " << p.location();
+        LOG(INFO) << "Uniform(" << uniform << ") located at " << location;
     }
     return result;
 }
 
-GLuint compileProgram(GLuint vs, GLuint tcs, GLuint tes, GLuint fs) {
+// programs which use per frame uniforms read them from the shared buffer.
+void bindFrameUniforms(GLuint program) {
+    auto block = glGetUniformBlockIndex(program, billiard::FrameUniforms::BLOCK_NAME);
+    if (block != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, block, billiard::FrameUniforms::BINDING);
+    }
+}
+
+GLuint linkProgram(GLuint vs, GLuint tcs, GLuint tes, GLuint fs, bool retrievable) {
     auto program = glCreateProgram();
     glAttachShader(program, vs);
     if (tcs) {
@@ -111,39 +158,144 @@ GLuint compileProgram(GLuint vs, GLuint tcs, GLuint tes, GLuint fs) {
     }
 
     glAttachShader(program, fs);
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram (program);
+    return program;
+}
 
-    GLint linked;
-    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+ProgramCache *Program::sCache = nullptr;
+
+Program::Program(const std::string &defines, const std::string &vertexSource, 
+        const std::string &fragmentSource) 
+        : mProgram(0)
+        , mCacheKey(0)
+        , mPending(false)
+        , mFailed(false) {
+    create(defines, vertexSource, nullptr, nullptr, fragmentSource);
+}
+
+Program::Program(const std::string &defines, const std::string &vertexSource, const std::string &tessControlSource,
+        const std::string &tessEvalSource, const std::string &fragmentSource)
+        : mProgram(0)
+        , mCacheKey(0)
+        , mPending(false)
+        , mFailed(false) {
+    create(defines, vertexSource, &tessControlSource, &tessEvalSource, fragmentSource);
+}
+
+void Program::create(const std::string &defines, const std::string &vertexSource, const std::string *tessControlSource,
+        const std::string *tessEvalSource, const std::string &fragmentSource) {
+    auto start = Clock::now();
+    if (stats.programs++ == 0) {
+        firstSubmit = start;
+    }
+
+    auto vertex = createSources(defines, vertexSource);
+    auto fragment = createSources(defines, fragmentSource);
+    std::vector<std::string> tessControl, tessEval;
+    std::vector<const std::vector<std::string> *> stages(1, &vertex);
+    if (tessControlSource && tessEvalSource) {
+        tessControl = createSources(defines, *tessControlSource);
+        tessEval = createSources(defines, *tessEvalSource);
+        stages.push_back(&tessControl);
+        stages.push_back(&tessEval);
+    }
+    stages.push_back(&fragment);
+
+    if (sCache) {
+        mCacheKey = sCache->computeKey(stages);
+        mProgram = sCache->load(mCacheKey);
+    }
 
+    // shaders are kept only for programs linked here, binaries do not need them.
+    // nothing is checked until the program is used, so the driver may compile
+    // this one while the next is submitted.
+    if (!mProgram) {
+        mVertexShader = Shader::create<GL_VERTEX_SHADER>(vertex);
+        if (!tessControl.empty()) {
+            mTessControlShader = Shader::create<GL_TESS_CONTROL_SHADER>(tessControl);
+            mTessEvalShader = Shader::create<GL_TESS_EVALUATION_SHADER>(tessEval);
+        }
+        mFragmentShader = Shader::create<GL_FRAGMENT_SHADER>(fragment);
+        mProgram = linkProgram(mVertexShader, mTessControlShader, mTessEvalShader, mFragmentShader,
+            sCache && sCache->isSupported());
+    }
+    mPending = true;
+    stats.submitMs += elapsedMs(start);
+}
+
+void Program::finish() const {
+    if (mFailed) {
+        throw std::runtime_error("Program failed to build earlier");
+    }
+    if (!mPending) {
+        return;
+    }
+    auto start = Clock::now();
+
+    GLint linked;
+    glGetProgramiv(mProgram, GL_LINK_STATUS, &linked);
+    if (mVertexShader) {
+        // messages of shaders that compiled are warnings, they are logged too
+        auto compiled = mVertexShader.checkCompileStatus();
+        compiled = (!mTessControlShader || mTessControlShader.checkCompileStatus()) && compiled;
+        compiled = (!mTessEvalShader || mTessEvalShader.checkCompileStatus()) && compiled;
+        compiled = mFragmentShader.checkCompileStatus() && compiled;
+        if (!compiled) {
+            mPending = false;
+            mFailed = true;
+            throw std::runtime_error("failed to compile shader");
+        }
+    }
     if (!linked) {
+        mPending = false;
+        mFailed = true;
         throw std::runtime_error("Error linking program");
     }
+    mPending = false;
+
+    // block bindings are not part of the binary
+    bindFrameUniforms(mProgram);
+    mAttributes = loadAttributeLocations(mProgram);
+    mUniforms = loadUniformLocations(mProgram);
+    if (sCache && mVertexShader) {
+        sCache->store(mCacheKey, mProgram);
+    }
 
-    return program;
+    stats.waitMs += elapsedMs(start);
+    stats.wallMs = elapsedMs(firstSubmit);
 }
 
-Program::Program(const std::string &defines, const std::string &vertexSource, 
-        const std::string &fragmentSource) 
-        : mVertexShader(Shader::create<GL_VERTEX_SHADER>(createSources(defines, vertexSource)))
-        , mFragmentShader(Shader::create<GL_FRAGMENT_SHADER>(createSources(defines, fragmentSource)))
-        , mProgram(compileProgram(mVertexShader, 0, 0, mFragmentShader))
-        , mAttributes(loadAttributeLocations(mProgram))
-        , mUniforms(loadUniformLocations(mProgram)) {
+bool Program::isReady() const {
+    if (!mPending || !hasParallelCompile()) {
+        return true;
+    }
+    GLint completed = GL_FALSE;
+    glGetProgramiv(mProgram, COMPLETION_STATUS, &completed);
+    return completed != GL_FALSE;
 }
 
-Program::Program(const std::string &defines, const std::string &vertexSource, const std::string &tessControlSource,
-        const std::string &tessEvalSource, const std::string &fragmentSource)
-        : mVertexShader(Shader::create<GL_VERTEX_SHADER>(createSources(defines, vertexSource)))
-        , mTessControlShader(Shader::create<GL_TESS_CONTROL_SHADER>(createSources(defines, tessControlSource)))
-        , mTessEvalShader(Shader::create<GL_TESS_EVALUATION_SHADER>(createSources(defines, tessEvalSource)))
-        , mFragmentShader(Shader::create<GL_FRAGMENT_SHADER>(createSources(defines, fragmentSource)))
-        , mProgram(compileProgram(mVertexShader, mTessControlShader, mTessEvalShader, mFragmentShader))
-        , mAttributes(loadAttributeLocations(mProgram))
-        , mUniforms(loadUniformLocations(mProgram)) {
+void Program::swap(Program &other) {
+    std::swap(mVertexShader, other.mVertexShader);
+    std::swap(mTessControlShader, other.mTessControlShader);
+    std::swap(mTessEvalShader, other.mTessEvalShader);
+    std::swap(mFragmentShader, other.mFragmentShader);
+    std::swap(mProgram, other.mProgram);
+    std::swap(mUniforms, other.mUniforms);
+    std::swap(mAttributes, other.mAttributes);
+    std::swap(mCacheKey, other.mCacheKey);
+    std::swap(mPending, other.mPending);
+    std::swap(mFailed, other.mFailed);
+}
+
+Program::CompileStats Program::getCompileStats() {
+    return stats;
 }
 
 Program::~Program() {
+    billiard::GlState::programDeleted(mProgram);
     glDeleteProgram(mProgram);
 }
 
@@ -201,7 +353,11 @@ void Program::setUniformMat3(const std::string &name, bool transpose, const floa
         LOG(WARNING) << "Unknown uniform : " << name;
         return;
     }
-    glUniformMatrix3fv(loc, 1, transpose, value);
+    setUniformMat3(loc, transpose, value);
+}
+
+void Program::setUniformMat3(int location, bool transpose, const float *value) const {
+    glUniformMatrix3fv(location, 1, transpose, value);
 }
 
 void Program::setUniformMat4(const std::string &name, bool transpose, const float *value) const {
@@ -210,7 +366,11 @@ void Program::setUniformMat4(const std::string &name, bool transpose, const floa
         LOG(WARNING) << "Unknown uniform : " << name;
         return;
     }
-    glUniformMatrix4fv(loc, 1, transpose, value);
+    setUniformMat4(loc, transpose, value);
+}
+
+void Program::setUniformMat4(int location, bool transpose, const float *value) const {
+    glUniformMatrix4fv(location, 1, transpose, value);
 }
 
 void Program::setUniformVec4(int location, const float *value, const int count) const {
@@ -236,17 +396,23 @@ void Program::setUniformVec3(const std::string &name, const float *value) const
         LOG(WARNING) << "Unknown uniform : " << name;
         return;
     }
-    glUniform3fv(loc, 1, value);
+    setUniformVec3(loc, value);
+}
+
+void Program::setUniformVec3(int location, const float *value) const {
+    glUniform3fv(location, 1, value);
 }
 
 void Program::bind() const {
     if (!mProgram) {
         return;
     }
-    glUseProgram(mProgram);
+    finish();
+    billiard::GlState::useProgram(mProgram);
 }
 
 int Program::getAttribLocation(const std::string &name) const {
+    finish();
     for (auto it = mAttributes.begin(); it != mAttributes.end(); ++it) {
         if (it->name().compare(name) == 0) {
             return it->location();
@@ -256,12 +422,9 @@ int Program::getAttribLocation(const std::string &name) const {
 }
 
 int Program::getUniformLocation(const std::string &name) const {
-    for (auto it = mUniforms.begin(); it != mUniforms.end(); ++it) {
-        if (it->name().compare(name) == 0) {
-            return it->location();
-        }
-    }
-    return -1;
+    finish();
+    auto it = mUniforms.find(name);
+    return it != mUniforms.end() ? it->second : -1;
 }
 
 std::string loadShaderFromFile(const std::string &fileName) {
@@ -9,14 +9,21 @@
 
 #include <vector>
 #include <utility>
+#include <unordered_map>
 #include <exception>
+#include <cstdint>
 
 #include <glm/glm.hpp>
 
+#include "GlState.h"
+
 namespace glsl {
 
+class ProgramCache;
+
 namespace detail {
     
+// submits sources only, the status is read later so drivers may compile in the background.
 template <typename It>
 void compileShader(GLuint shader, It sourceBegin, It sourceEnd) {
     auto size = std::distance(sourceBegin, sourceEnd);
@@ -31,7 +38,6 @@ void compileShader(GLuint shader, It sourceBegin, It sourceEnd) {
 
     glShaderSource(shader, size, csource.data(), lengths.data());
     glCompileShader(shader);
-    logShaderInfo(shader);
 }
 
 }
@@ -69,17 +75,17 @@ public:
 
         auto shader = glCreateShader(type);
         detail::compileShader(shader, sourceBegin, sourceEnd);
-        if (!checkCompileStatus(shader)) {
-            glDeleteShader(shader);
-            throw std::runtime_error("failed to compile shader");
-        }
         return shader;
     }
+
+    // waits for the compiler, logs its messages and returns the status.
+    bool checkCompileStatus() const;
+
     Shader() : shader(0) {}
     Shader(Shader&) = delete;
     Shader(Shader&& s) : shader(s.shader) { s.shader = 0; }
     Shader &operator=(Shader&) = delete;
-    Shader &operator=(Shader&& s) { release(); shader = s.shader; s.shader = 0; }
+    Shader &operator=(Shader&& s) { release(); shader = s.shader; s.shader = 0; return *this; }
     ~Shader() { release(); }
 
     operator GLuint() const { return shader; }
@@ -102,9 +108,28 @@ private:
     Shader mFragmentShader;
     GLuint mProgram;
 
-    std::vector<Uniform> mUniforms;
-    std::vector<Uniform> mAttributes;
+    // filled when the program is checked
+    mutable std::unordered_map<std::string, int> mUniforms;
+    mutable std::vector<Uniform> mAttributes;
+
+    std::uint64_t mCacheKey;
+    // compiled and linked but not checked yet
+    mutable bool mPending;
+    // checked and broken, every later use throws again
+    mutable bool mFailed;
+
+    static ProgramCache *sCache;
+
+    void create(const std::string &defines, const std::string &vertexSource, const std::string *tessControlSource,
+            const std::string *tessEvalSource, const std::string &fragmentSource);
 public:
+    struct CompileStats {
+        int programs;
+        double submitMs; // spent issuing compile and link calls
+        double waitMs; // spent blocked on statuses
+        double wallMs; // first submission to the last program checked
+    };
+
     Program(const std::string &defines, const std::string &vertexSource, const std::string &fragmentSource);
     Program(const std::string &defines, 
             const std::string &vertexSource, const std::string &tessControlSource,
@@ -115,7 +140,24 @@ public:
     Program& operator=(Program&&); // = delete; // can be implemented though.
     ~Program();
 
-    static void unbind() { glUseProgram(0); }
+    static void unbind() { billiard::GlState::useProgram(0); }
+
+    // programs created afterwards load from and store to cache, nullptr disables it.
+    static void setCache(ProgramCache *cache) { sCache = cache; }
+
+    static CompileStats getCompileStats();
+
+    /*
+        True once using the program will not wait for the compiler. Needs
+        KHR or ARB_parallel_shader_compile, without them it is always true.
+    */
+    bool isReady() const;
+
+    // checks compile and link status now, throws if either failed, now or before.
+    void finish() const;
+
+    // exchanges everything, so a rebuilt program takes the place of this one.
+    void swap(Program &other);
 
     void bind() const;
     
@@ -126,17 +168,21 @@ public:
     void setUniformInt(const int location, int value) const;
     
     void setUniformMat4(const std::string &name, bool transpose, const float *value) const;
+    void setUniformMat4(int location, bool transpose, const float *value) const;
     void setUniformMat3(const std::string &name, bool transpose, const float *value) const;
+    void setUniformMat3(int location, bool transpose, const float *value) const;
 
     void setUniformVec4(const std::string &name, const float *value, const int count = 1) const;
     void setUniformVec4(int location, const float *value, const int count = 1) const;
     void setUniformVec3(const std::string &name, const float *value) const;
+    void setUniformVec3(int location, const float *value) const;
 
     bool setAttrPtr(const std::string &name, int numComponents, GLsizei stride, void *ptr, 
         GLenum type = GL_FLOAT, bool normalized = false) const;
     static void setAttrPtr(GLuint index, int numComponents, GLsizei stride, void *ptr, 
         GLenum type = GL_FLOAT, bool normalized = false);
 
+    // resolve once at init and pass the location to setters in per frame code.
     int getUniformLocation(const std::string &name) const;
     int getAttribLocation(const std::string &name) const;
 };
@@ -0,0 +1,204 @@
+#include "StdAfx.h"
+#include "HeadlessContext.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// unless a backend is asked for: Windows has no EGL, but glfw3.lib is linked anyway
+#if !defined(BILLIARD_HEADLESS_EGL) && !defined(BILLIARD_HEADLESS_OSMESA) && !defined(BILLIARD_HEADLESS_GLFW)
+    #ifdef _WIN32
+        #define BILLIARD_HEADLESS_GLFW
+    #else
+        #define BILLIARD_HEADLESS_EGL
+    #endif
+#endif
+
+#if defined(BILLIARD_HEADLESS_EGL)
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#elif defined(BILLIARD_HEADLESS_OSMESA)
+    #include <GL\glew.h>
+    #include <GL\osmesa.h>
+#elif defined(BILLIARD_HEADLESS_GLFW)
+    #include <GLFW\glfw3.h>
+#endif
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+#if defined(BILLIARD_HEADLESS_EGL)
+
+namespace {
+    std::string toHex(EGLint value) {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%04X", static_cast<unsigned>(value));
+        return buffer;
+    }
+}
+
+struct HeadlessContext::Backend {
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+
+    Backend(int width, int height) : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {
+        // prefer a display that needs no X server at all
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+        if (display == EGL_NO_DISPLAY) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            throw std::runtime_error("Cannot initialize EGL display");
+        }
+        LOG(INFO) << "EGL " << major << "." << minor << ", " << eglQueryString(display, EGL_VENDOR);
+
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_STENCIL_SIZE, 8,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount < 1) {
+            eglTerminate(display);
+            throw std::runtime_error("No EGL config for desktop GL pbuffers");
+        }
+
+        const EGLint surfaceAttribs[] = {
+            EGL_WIDTH, width,
+            EGL_HEIGHT, height,
+            EGL_NONE
+        };
+        surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+        if (surface == EGL_NO_SURFACE) {
+            eglTerminate(display);
+            throw std::runtime_error("Cannot create " + std::to_string(width) + "x" + std::to_string(height)
+                                     + " EGL pbuffer, error 0x" + toHex(eglGetError()));
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 1,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        eglBindAPI(EGL_OPENGL_API);
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+            release();
+            throw std::runtime_error("Cannot create EGL GL 4.1 core context");
+        }
+    }
+
+    ~Backend() {
+        release();
+    }
+
+    void release() {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(display, context);
+        }
+        if (surface != EGL_NO_SURFACE) {
+            eglDestroySurface(display, surface);
+        }
+        eglTerminate(display);
+    }
+};
+
+const char *HeadlessContext::getBackendName() {
+    return "egl";
+}
+
+#elif defined(BILLIARD_HEADLESS_OSMESA)
+
+struct HeadlessContext::Backend {
+    OSMesaContext context;
+    std::vector<unsigned char> buffer;
+
+    Backend(int width, int height) : buffer(width * height * 4) {
+        const int attribs[] = {
+            OSMESA_FORMAT, OSMESA_RGBA,
+            OSMESA_DEPTH_BITS, 24,
+            OSMESA_STENCIL_BITS, 8,
+            OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, 4,
+            OSMESA_CONTEXT_MINOR_VERSION, 1,
+            0
+        };
+        context = OSMesaCreateContextAttribs(attribs, nullptr);
+        if (!context) {
+            throw std::runtime_error("Cannot create OSMesa GL 4.1 core context");
+        }
+        if (!OSMesaMakeCurrent(context, buffer.data(), GL_UNSIGNED_BYTE, width, height)) {
+            OSMesaDestroyContext(context);
+            throw std::runtime_error("Cannot make OSMesa context current");
+        }
+    }
+
+    ~Backend() {
+        OSMesaDestroyContext(context);
+    }
+};
+
+const char *HeadlessContext::getBackendName() {
+    return "osmesa";
+}
+
+#elif defined(BILLIARD_HEADLESS_GLFW)
+
+struct HeadlessContext::Backend {
+    GLFWwindow *window;
+
+    Backend(int width, int height) {
+        if (!glfwInit()) {
+            throw std::runtime_error("glfwInit failed");
+        }
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        window = glfwCreateWindow(width, height, "", nullptr, nullptr);
+        if (!window) {
+            glfwTerminate();
+            throw std::runtime_error("Cannot create hidden GLFW window");
+        }
+        glfwMakeContextCurrent(window);
+    }
+
+    ~Backend() {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+};
+
+const char *HeadlessContext::getBackendName() {
+    return "glfw";
+}
+
+#endif
+
+HeadlessContext::HeadlessContext(int width, int height)
+        : backend_(new Backend(width, height)) {
+    LOG(INFO) << "headless context: " << getBackendName() << ", " << width << "x" << height;
+}
+
+HeadlessContext::~HeadlessContext() {
+}
+
+}
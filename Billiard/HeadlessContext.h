@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+
+namespace billiard {
+
+/**
+* GL 4.1 core context without a visible window, made current on creation.
+* The backend is picked at build time:
+*   BILLIARD_HEADLESS_EGL    - EGL pbuffer, works with Mesa llvmpipe and
+*                              GPU drivers, GLEW must be built with GLEW_EGL;
+*                              the default everywhere but Windows;
+*   BILLIARD_HEADLESS_OSMESA - OSMesa software renderer into client memory,
+*                              GLEW must be built with GLEW_OSMESA; the
+*                              "Release OSMesa" configuration defines it and
+*                              links osmesa.lib from libs/osmesa;
+*   BILLIARD_HEADLESS_GLFW   - hidden GLFW window, still needs a display;
+*                              the default on Windows.
+* Rendering should go into an application framebuffer object, the context's
+* own surface is only a placeholder.
+*/
+class HeadlessContext
+{
+    struct Backend;
+    std::unique_ptr<Backend> backend_;
+
+public:
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &) = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    // "egl", "osmesa" or "glfw".
+    static const char *getBackendName();
+};
+
+}
@@ -0,0 +1,223 @@
+#include "StdAfx.h"
+#include "Image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "glog\logging.h"
+#include <FreeImage.h>
+
+#include "CpuFeatures.h"
+
+namespace billiard {
+namespace image {
+
+namespace {
+    // owns a bitmap converted to 24 or 32 bits per pixel.
+    class Bitmap {
+        FIBITMAP *bitmap_;
+        Info info_;
+
+        void convert(FIBITMAP *(DLL_CALLCONV *to)(FIBITMAP *)) {
+            auto converted = to(bitmap_);
+            FreeImage_Unload(bitmap_);
+            bitmap_ = converted;
+        }
+    public:
+        explicit Bitmap(const char *filename) : bitmap_(FreeImage_Load(FIF_PNG, filename)) {
+            if (!bitmap_) {
+                throw std::runtime_error(std::string("Cannot load image ") + filename);
+            }
+
+            // keeps alpha of transparent images, everything else goes to 8 bit rgb
+            auto bpp = FreeImage_GetBPP(bitmap_);
+            auto type = FreeImage_GetImageType(bitmap_);
+            if (type != FIT_BITMAP || (bpp != 24 && bpp != 32)) {
+                convert(FreeImage_IsTransparent(bitmap_) || type == FIT_RGBA16
+                    ? FreeImage_ConvertTo32Bits : FreeImage_ConvertTo24Bits);
+            }
+            if (!bitmap_) {
+                throw std::runtime_error(std::string("Cannot convert image ") + filename);
+            }
+
+            info_.width = FreeImage_GetWidth(bitmap_);
+            info_.height = FreeImage_GetHeight(bitmap_);
+            info_.channels = FreeImage_GetBPP(bitmap_) / 8;
+            info_.levels = 1;
+        }
+
+        ~Bitmap() {
+            FreeImage_Unload(bitmap_);
+        }
+
+        Bitmap(const Bitmap &) = delete;
+        Bitmap &operator=(const Bitmap &) = delete;
+
+        const Info &info() const { return info_; }
+
+        // dst holds info().size() bytes. FreeImage rows are bottom first already.
+        void copyTo(unsigned char *dst) const {
+            auto src = FreeImage_GetBits(bitmap_);
+            auto pitch = FreeImage_GetPitch(bitmap_);
+            auto rowSize = info_.rowSize();
+            auto swizzle = FI_RGBA_RED == 0 ? nullptr : activeSwizzle();
+            for (unsigned int y = 0; y < info_.height; y++) {
+                if (swizzle) {
+                    swizzle(src, dst, info_.width, info_.channels);
+                } else {
+                    std::memcpy(dst, src, rowSize);
+                }
+                src += pitch;
+                dst += rowSize;
+            }
+        }
+    };
+}
+
+size_t Info::levelOffset(unsigned int level) const {
+    size_t offset = 0;
+    for (unsigned int i = 0; i < level; i++) {
+        offset += levelSize(i);
+    }
+    return offset;
+}
+
+void swizzleRowScalar(const unsigned char *src, unsigned char *dst,
+        unsigned int width, unsigned int channels) {
+    for (unsigned int x = 0; x < width; x++) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        if (channels == 4) {
+            dst[3] = src[3];
+        }
+        src += channels;
+        dst += channels;
+    }
+}
+
+SwizzleFn activeSwizzle() {
+    static const SwizzleFn swizzle = cpu::hasSsse3() ? swizzleRowSsse3 : swizzleRowScalar;
+    return swizzle;
+}
+
+Info load(const char *filename, std::vector<unsigned char> &pixels) {
+    Bitmap bitmap(filename);
+    pixels.resize(bitmap.info().size());
+    bitmap.copyTo(pixels.data());
+    return bitmap.info();
+}
+
+Pixels load(const char *filename) {
+    Pixels pixels;
+    pixels.info = load(filename, pixels.data);
+    return pixels;
+}
+
+void generateMips(Pixels &pixels) {
+    auto &info = pixels.info;
+    auto levels = 1u;
+    while (info.levelWidth(levels - 1) > 1 || info.levelHeight(levels - 1) > 1) {
+        levels++;
+    }
+    info.levels = levels;
+    pixels.data.resize(info.size());
+
+    auto channels = info.channels;
+    for (unsigned int level = 1; level < levels; level++) {
+        auto src = pixels.data.data() + info.levelOffset(level - 1);
+        auto dst = pixels.data.data() + info.levelOffset(level);
+        auto srcWidth = info.levelWidth(level - 1);
+        auto srcHeight = info.levelHeight(level - 1);
+        auto width = info.levelWidth(level);
+        auto height = info.levelHeight(level);
+
+        // odd sizes clamp the second texel to the edge
+        for (unsigned int y = 0; y < height; y++) {
+            auto y0 = std::min(2 * y, srcHeight - 1);
+            auto y1 = std::min(2 * y + 1, srcHeight - 1);
+            for (unsigned int x = 0; x < width; x++) {
+                auto x0 = std::min(2 * x, srcWidth - 1);
+                auto x1 = std::min(2 * x + 1, srcWidth - 1);
+                for (unsigned int c = 0; c < channels; c++) {
+                    auto sum = src[(y0 * srcWidth + x0) * channels + c] + src[(y0 * srcWidth + x1) * channels + c]
+                             + src[(y1 * srcWidth + x0) * channels + c] + src[(y1 * srcWidth + x1) * channels + c];
+                    dst[(y * width + x) * channels + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+    }
+}
+
+Uploader::Uploader() : capacity_(0) {
+}
+
+unsigned char *Uploader::map(size_t size, const char *name) {
+    pbo_.bind<GL_PIXEL_UNPACK_BUFFER>();
+    if (size > capacity_) {
+        capacity_ = size;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, capacity_, nullptr, GL_STREAM_DRAW);
+    }
+
+    // invalidating lets the driver hand out fresh memory while the last upload is pending
+    auto dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (!dst) {
+        VertexBuffer::unbind<GL_PIXEL_UNPACK_BUFFER>();
+        throw std::runtime_error(std::string("Cannot map unpack buffer for ") + name);
+    }
+    return static_cast<unsigned char *>(dst);
+}
+
+void Uploader::unmap(const char *name) {
+    if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+        VertexBuffer::unbind<GL_PIXEL_UNPACK_BUFFER>();
+        throw std::runtime_error(std::string("Unpack buffer was lost while staging ") + name);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+Info Uploader::stage(const char *filename) {
+    Bitmap bitmap(filename);
+    bitmap.copyTo(map(bitmap.info().size(), filename));
+    unmap(filename);
+    return bitmap.info();
+}
+
+const unsigned char *Uploader::source(const Pixels &pixels) {
+    if (pixels.mapped) {
+        // the mapping serves as client memory, staging would only copy it once more
+        VertexBuffer::unbind<GL_PIXEL_UNPACK_BUFFER>();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        return pixels.mapped;
+    }
+    auto size = pixels.info.size();
+    std::memcpy(map(size, "pixels"), pixels.bytes(), size);
+    unmap("pixels");
+    return nullptr;
+}
+
+void Uploader::upload2D(const Pixels &pixels) {
+    auto data = source(pixels);
+    const auto &info = pixels.info;
+    for (unsigned int level = 0; level < info.levels; level++) {
+        auto offset = info.levelOffset(level);
+        auto levelData = data ? static_cast<const void *>(data + offset) : reinterpret_cast<const void *>(offset);
+        glTexImage2D(GL_TEXTURE_2D, level, info.internalFormat(), info.levelWidth(level), info.levelHeight(level),
+            0, info.format(), GL_UNSIGNED_BYTE, levelData);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, info.levels - 1);
+    if (info.levels > 1) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+}
+
+void Uploader::finish() {
+    VertexBuffer::unbind<GL_PIXEL_UNPACK_BUFFER>();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <GL\glew.h>
+
+#include "VertexBuffer.h"
+
+namespace billiard {
+namespace image {
+
+/**
+* Size and layout of a decoded image. Rows are tightly packed and go bottom
+* first, as GL expects them, pixels are RGB or RGBA if the file has alpha.
+* Mip levels, if any, follow the base level, each half the size of the last.
+*/
+struct Info {
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int levels;
+
+    unsigned int levelWidth(unsigned int level) const { return width >> level ? width >> level : 1; }
+    unsigned int levelHeight(unsigned int level) const { return height >> level ? height >> level : 1; }
+    size_t levelSize(unsigned int level) const {
+        return static_cast<size_t>(levelWidth(level)) * levelHeight(level) * channels;
+    }
+    size_t levelOffset(unsigned int level) const;
+
+    size_t rowSize() const { return static_cast<size_t>(width) * channels; }
+    // all levels
+    size_t size() const { return levelOffset(levels); }
+
+    GLenum format() const { return channels == 4 ? GL_RGBA : GL_RGB; }
+    GLenum internalFormat() const { return channels == 4 ? GL_RGBA8 : GL_RGB8; }
+};
+
+/*
+    Decoded image kept in client memory until the GL thread uploads it.
+    Texels either live in data or, for images from a bundle, in its mapping.
+*/
+struct Pixels {
+    Info info;
+    std::vector<unsigned char> data;
+    const unsigned char *mapped;
+
+    Pixels() : mapped(nullptr) {}
+    const unsigned char *bytes() const { return mapped ? mapped : data.data(); }
+};
+
+// bgr(a) to rgb(a) for one row of width pixels, channels is 3 or 4.
+typedef void (*SwizzleFn)(const unsigned char *src, unsigned char *dst,
+        unsigned int width, unsigned int channels);
+
+void swizzleRowScalar(const unsigned char *src, unsigned char *dst,
+        unsigned int width, unsigned int channels);
+void swizzleRowSsse3(const unsigned char *src, unsigned char *dst,
+        unsigned int width, unsigned int channels);
+
+// the fastest swizzle supported by this CPU, detected once.
+SwizzleFn activeSwizzle();
+
+// decodes a png into pixels, reusing their capacity. Throws if the file cannot be read.
+Info load(const char *filename, std::vector<unsigned char> &pixels);
+Pixels load(const char *filename);
+
+// appends box filtered levels down to 1x1 to a single level image in data.
+void generateMips(Pixels &pixels);
+
+/*
+    Decodes images straight into a pixel unpack buffer, so glTexImage* reads
+    them from the buffer instead of client memory. One uploader may stage
+    many images, the buffer only grows. Images mapped from a bundle skip
+    the buffer, GL reads them from the mapping.
+*/
+class Uploader {
+    const VertexBuffer pbo_;
+    size_t capacity_;
+
+    unsigned char *map(size_t size, const char *name);
+    void unmap(const char *name);
+public:
+    Uploader();
+
+    Uploader(const Uploader &) = delete;
+    Uploader &operator=(const Uploader &) = delete;
+
+    /*
+        Leaves the buffer bound with unpack alignment 1, glTexImage* calls
+        pass nullptr pixels until finish(). Throws if the file cannot be read.
+    */
+    Info stage(const char *filename);
+
+    /*
+        What glTexImage* calls pass as pixels, level offsets added: the
+        mapping of bundle pixels, read in place with the buffer unbound, or
+        nullptr for decoded pixels, which are copied into the buffer.
+    */
+    const unsigned char *source(const Pixels &pixels);
+
+    /*
+        Uploads every level of pixels to the bound GL_TEXTURE_2D, switching
+        its min filter to trilinear when there are mips.
+    */
+    void upload2D(const Pixels &pixels);
+
+    // restores the default unpack state.
+    static void finish();
+};
+
+}
+}
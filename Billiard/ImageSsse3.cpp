@@ -0,0 +1,40 @@
+#include "StdAfx.h"
+#include "Image.h"
+
+#include <tmmintrin.h>
+
+/*
+    Only code in this file uses SSSE3, it is called after hasSsse3 confirmed
+    support, same as the AVX2 kernels.
+*/
+#if defined(__GNUC__) && !defined(__SSSE3__)
+    #pragma GCC target("ssse3")
+#endif
+
+namespace billiard {
+namespace image {
+
+void swizzleRowSsse3(const unsigned char *src, unsigned char *dst,
+        unsigned int width, unsigned int channels) {
+    auto size = static_cast<size_t>(width) * channels;
+    size_t i = 0;
+    if (channels == 4) {
+        // four pixels per shuffle
+        const auto mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        for (; i + 16 <= size; i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(v, mask));
+        }
+    } else {
+        // five pixels per shuffle, the 16th byte is rewritten by the next step or the tail
+        const auto mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+        for (; i + 16 <= size; i += 15) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_shuffle_epi8(v, mask));
+        }
+    }
+    swizzleRowScalar(src + i, dst + i, static_cast<unsigned int>((size - i) / channels), channels);
+}
+
+}
+}
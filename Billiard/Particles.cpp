@@ -4,35 +4,36 @@
 #include <cmath>
 #include <utility>
 #include <vector>
-#include <random>
+
+#include "Random.h"
 
 namespace billiard {
 
 namespace {
     const int PARTICLES_AMOUNT = 1024;
 
-    VertexBuffer createParticles(float length, float radius) {
+    VertexBuffer createParticles(float length, float radius, std::uint64_t seed) {
         std::vector<glm::vec4> v;
 
-        std::random_device rd;
-        std::default_random_engine rng(rd()); 
-        std::uniform_real_distribution<float> xyDistrib(-radius, radius);
-        std::uniform_real_distribution<float> zDistrib(0, length);
-        std::uniform_real_distribution<float> timeDistrib(0, static_cast<float>(2 * M_PI));
-
+        Random rng(seed);
         for (auto i = 0; i < PARTICLES_AMOUNT; i++) {
-            v.push_back(glm::vec4(xyDistrib(rng), xyDistrib(rng), zDistrib(rng), timeDistrib(rng)));
+            auto x = rng.uniform(-radius, radius);
+            auto y = rng.uniform(-radius, radius);
+            auto z = rng.uniform(0, length);
+            auto time = rng.uniform(0, static_cast<float>(2 * M_PI));
+            v.push_back(glm::vec4(x, y, z, time));
         }
 
         return std::move(VertexBuffer::create<GL_ARRAY_BUFFER>(v.data(), v.size()));
     }
 }
 
-Particles::Particles(const std::string &exePath, float length, float radius) 
+Particles::Particles(const std::string &exePath, float length, float radius,
+        std::uint64_t seed)
         : program_("", 
                    glsl::loadShaderFromFile(exePath + "../assets/shaders/particles.vert"), 
                    glsl::loadShaderFromFile(exePath + "../assets/shaders/particles.frag"))
-        , vbo_(createParticles(length, radius)) {
+        , vbo_(createParticles(length, radius, seed)) {
     glBindVertexArray(vao_);
     vbo_.bind<GL_ARRAY_BUFFER>();
     glsl::Program::setAttrPtr(0, 4, 0, nullptr);
@@ -40,11 +41,10 @@ Particles::Particles(const std::string &exePath, float length, float radius)
     VertexBuffer::unbind<GL_ARRAY_BUFFER>();
 }
 
-void Particles::render(const Frustum &frustum) const {
+void Particles::render() const {
+    // view and projection come from FrameUniforms
     glBindVertexArray(vao_);
     program_.bind();
-    program_.setUniformMat4("u_ProjectionMat", false, frustum.getProjPtr());
-    program_.setUniformMat4("u_ViewMat", false, frustum.getViewPtr());
 
     glDrawArrays(GL_POINTS, 0, PARTICLES_AMOUNT);
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sstream>
+#include <cstdint>
 
 #include <GL\glew.h>
 #include <GL\GL.h>
@@ -19,7 +20,9 @@ class Particles {
     const VertexBuffer vbo_;
     const glsl::Program program_;
 public:
-    Particles(const std::string &exePath, float length, float radius);
+    // same seed gives the same particle cloud on every run.
+    Particles(const std::string &exePath, float length, float radius,
+              std::uint64_t seed = 1);
 
     template <int N>
     void setClipPlanes(glm::vec4 (&lightFrustum)[N]) const {
@@ -31,7 +34,7 @@ public:
         glsl::Program::unbind();
     }
 
-    void render(const Frustum &frustum) const;
+    void render() const;
 };
 
 }
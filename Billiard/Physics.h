@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Dimensions.h"
+
+namespace billiard {
+namespace physics {
+
+const float RADIUS = BALL_DIAMETER / 2;
+
+// a real ball is 57.15 mm wide, so one world unit is that much meters.
+const float UNIT = 0.05715f / BALL_DIAMETER;
+const float GRAVITY = 9.81f / UNIT;
+
+const float SLIDING_FRICTION = 0.2f;
+const float ROLLING_FRICTION = 0.01f;
+const float SPINNING_FRICTION = 0.044f;
+
+const float BALL_RESTITUTION = 0.95f;
+const float CUSHION_RESTITUTION = 0.8f;
+
+// |du/dt| of the contact point while sliding.
+const float SLIDING_DECEL = 3.5f * SLIDING_FRICTION * GRAVITY;
+const float ROLLING_DECEL = ROLLING_FRICTION * GRAVITY;
+const float SPIN_DECEL = 2.5f * SPINNING_FRICTION * GRAVITY / RADIUS;
+
+// speeds below this are treated as zero.
+const float EPSILON = 1e-4f;
+
+}
+}
@@ -0,0 +1,238 @@
+#include "StdAfx.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+namespace {
+    const size_t MAX_TRACE_EVENTS = 200000;
+
+    // microseconds since some fixed moment.
+    double now() {
+        auto time = std::chrono::high_resolution_clock::now().time_since_epoch();
+        return std::chrono::duration<double, std::micro>(time).count();
+    }
+}
+
+void Profiler::Rolling::add(double value) {
+    values_[next_] = value;
+    next_ = (next_ + 1) % WINDOW;
+    count_ = std::min(count_ + 1, WINDOW);
+}
+
+Profiler::Stats Profiler::Rolling::get() const {
+    Stats stats = { 0, 0 };
+    for (int i = 0; i < count_; i++) {
+        stats.average += values_[i];
+        stats.max = std::max(stats.max, values_[i]);
+    }
+    if (count_ > 0) {
+        stats.average /= count_;
+    }
+    return stats;
+}
+
+Profiler::Profiler() : depth_(0), current_(0), droppedFrames_(0) {
+    // timestamp queries are optional, counter bits are 0 without them
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    gpuTiming_ = bits > 0;
+    if (!gpuTiming_) {
+        LOG(WARNING) << "No timer queries, profiling CPU time only";
+    }
+
+    for (auto &frame : frames_) {
+        frame.usedQueries = 0;
+        frame.cpuBase = 0;
+        frame.gpuBase = 0;
+        frame.pending = false;
+    }
+}
+
+Profiler::~Profiler() {
+    for (auto &frame : frames_) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+    }
+}
+
+int Profiler::getPass(const char *name) {
+    auto it = passIndices_.find(name);
+    if (it != passIndices_.end()) {
+        return it->second;
+    }
+    Pass pass;
+    pass.name = name;
+    pass.depth = depth_;
+    passes_.push_back(pass);
+    auto index = static_cast<int>(passes_.size()) - 1;
+    passIndices_[name] = index;
+    return index;
+}
+
+void Profiler::beginFrame() {
+    current_ = (current_ + 1) % FRAME_LATENCY;
+    auto &frame = frames_[current_];
+    if (frame.pending) {
+        collect(frame);
+    }
+
+    frame.samples.clear();
+    frame.usedQueries = 0;
+    frame.pending = false;
+    frame.cpuBase = now();
+    if (gpuTiming_) {
+        // pairs gpu clock with cpu clock, so both go to the same trace timeline
+        glGetInteger64v(GL_TIMESTAMP, &frame.gpuBase);
+    }
+    depth_ = 0;
+}
+
+void Profiler::endFrame() {
+    frames_[current_].pending = true;
+}
+
+void Profiler::flush() {
+    glFinish();
+    for (int i = 1; i <= FRAME_LATENCY; i++) {
+        auto &frame = frames_[(current_ + i) % FRAME_LATENCY];
+        if (frame.pending) {
+            collect(frame);
+            frame.pending = false;
+        }
+    }
+}
+
+Profiler::Scope Profiler::scope(const char *name) {
+    auto &frame = frames_[current_];
+    Sample sample = { getPass(name), now(), 0, -1 };
+    depth_++;
+
+    if (gpuTiming_) {
+        if (frame.usedQueries + 2 > static_cast<int>(frame.queries.size())) {
+            GLuint queries[2];
+            glGenQueries(2, queries);
+            frame.queries.push_back(queries[0]);
+            frame.queries.push_back(queries[1]);
+        }
+        sample.query = frame.usedQueries;
+        frame.usedQueries += 2;
+        glQueryCounter(frame.queries[sample.query], GL_TIMESTAMP);
+    }
+
+    frame.samples.push_back(sample);
+    return Scope(this, static_cast<int>(frame.samples.size()) - 1);
+}
+
+void Profiler::count(const char *name, double value) {
+    auto it = counterIndices_.find(name);
+    if (it == counterIndices_.end()) {
+        Counter counter;
+        counter.name = name;
+        counters_.push_back(counter);
+        it = counterIndices_.insert(std::make_pair(std::string(name), static_cast<int>(counters_.size()) - 1)).first;
+    }
+    counters_[it->second].values.add(value);
+}
+
+void Profiler::end(int index) {
+    auto &frame = frames_[current_];
+    auto &sample = frame.samples[index];
+    if (sample.query >= 0) {
+        glQueryCounter(frame.queries[sample.query + 1], GL_TIMESTAMP);
+    }
+    sample.cpuEnd = now();
+    depth_--;
+}
+
+void Profiler::collect(Frame &frame) {
+    // timestamps complete in order, so the last one tells about all of them
+    auto gpuReady = false;
+    if (gpuTiming_ && frame.usedQueries > 0) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        gpuReady = available != 0;
+        if (!gpuReady && droppedFrames_++ == 0) {
+            LOG(WARNING) << "GPU is more than " << FRAME_LATENCY << " frames behind, dropping its timings";
+        }
+    }
+
+    for (const auto &sample : frame.samples) {
+        auto &pass = passes_[sample.pass];
+        auto duration = sample.cpuEnd - sample.cpuBegin;
+        pass.cpu.add(duration / 1000);
+        TraceEvent cpuEvent = { sample.pass, false, sample.cpuBegin, duration };
+        trace_.push_back(cpuEvent);
+
+        if (gpuReady) {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(frame.queries[sample.query], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[sample.query + 1], GL_QUERY_RESULT, &end);
+            pass.gpu.add((end - begin) / 1e6);
+
+            auto offset = static_cast<double>(static_cast<GLint64>(begin) - frame.gpuBase) / 1000;
+            TraceEvent gpuEvent = { sample.pass, true, frame.cpuBase + offset, (end - begin) / 1000.0 };
+            trace_.push_back(gpuEvent);
+        }
+    }
+
+    while (trace_.size() > MAX_TRACE_EVENTS) {
+        trace_.pop_front();
+    }
+}
+
+Profiler::Stats Profiler::getPassStats(const std::string &name, bool gpu) const {
+    auto found = passIndices_.find(name);
+    if (found == passIndices_.end()) {
+        Stats none = { 0, 0 };
+        return none;
+    }
+    const auto &pass = passes_[found->second];
+    return gpu ? pass.gpu.get() : pass.cpu.get();
+}
+
+void Profiler::report(std::ostream &out) const {
+    out << std::fixed << std::setprecision(3);
+    for (const auto &pass : passes_) {
+        auto cpu = pass.cpu.get();
+        out << std::string(pass.depth * 2, ' ') << pass.name
+            << ": cpu " << cpu.average << " ms (max " << cpu.max << ")";
+        if (gpuTiming_) {
+            auto gpu = pass.gpu.get();
+            out << ", gpu " << gpu.average << " ms (max " << gpu.max << ")";
+        }
+        out << std::endl;
+    }
+    for (const auto &counter : counters_) {
+        auto values = counter.values.get();
+        out << counter.name << ": " << values.average << " (max " << values.max << ")" << std::endl;
+    }
+}
+
+void Profiler::dumpTrace(const std::string &filename) const {
+    std::ofstream out(filename);
+    if (!out) {
+        throw std::runtime_error("Cannot write trace " + filename);
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+    for (const auto &event : trace_) {
+        out << ",\n{\"name\":\"" << passes_[event.pass].name << "\",\"cat\":\""
+            << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+            << (event.gpu ? 2 : 1) << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << "}";
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <deque>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL\glew.h>
+
+namespace billiard {
+
+/**
+* Measures CPU and GPU time of nested render passes. GPU times come from
+* timestamp queries that are read back FRAME_LATENCY frames later, so the
+* profiler never waits for the GPU. Drivers without timer queries (some
+* software renderers) get CPU times only.
+*/
+class Profiler
+{
+public:
+    static const int FRAME_LATENCY = 3;
+    static const int WINDOW = 120; // frames in rolling statistics
+
+    // ends the pass it was created for when destroyed.
+    class Scope {
+        Profiler *profiler_;
+        int sample_;
+    public:
+        Scope(Profiler *profiler, int sample) : profiler_(profiler), sample_(sample) {}
+        Scope(Scope &&s) : profiler_(s.profiler_), sample_(s.sample_) { s.profiler_ = nullptr; }
+        ~Scope() {
+            if (profiler_) {
+                profiler_->end(sample_);
+            }
+        }
+    };
+
+    struct Stats {
+        double average;
+        double max;
+    };
+
+private:
+    class Rolling {
+        double values_[WINDOW];
+        int count_;
+        int next_;
+    public:
+        Rolling() : count_(0), next_(0) {}
+        void add(double value);
+        Stats get() const;
+    };
+
+    struct Pass {
+        std::string name;
+        int depth;
+        Rolling cpu;
+        Rolling gpu;
+    };
+
+    struct Sample {
+        int pass;
+        double cpuBegin;
+        double cpuEnd;
+        int query; // index of the begin query in the frame, end is the next one
+    };
+
+    struct Frame {
+        std::vector<Sample> samples;
+        std::vector<GLuint> queries;
+        int usedQueries;
+        double cpuBase;
+        GLint64 gpuBase;
+        bool pending;
+    };
+
+    struct Counter {
+        std::string name;
+        Rolling values;
+    };
+
+    struct TraceEvent {
+        int pass;
+        bool gpu;
+        double begin; // microseconds
+        double duration;
+    };
+
+    bool gpuTiming_;
+    int depth_;
+    int current_;
+    Frame frames_[FRAME_LATENCY];
+
+    std::vector<Pass> passes_;
+    std::unordered_map<std::string, int> passIndices_;
+
+    std::vector<Counter> counters_;
+    std::unordered_map<std::string, int> counterIndices_;
+
+    std::deque<TraceEvent> trace_;
+    int droppedFrames_;
+
+    int getPass(const char *name);
+    void collect(Frame &frame);
+    void end(int sample);
+
+public:
+    Profiler();
+    ~Profiler();
+
+    Profiler(const Profiler &) = delete;
+    Profiler &operator=(const Profiler &) = delete;
+
+    void beginFrame();
+    void endFrame();
+
+    // waits for the GPU and collects frames still in flight, for batch runs.
+    void flush();
+
+    // auto scope = profiler.scope("name"); measures until the end of block.
+    Scope scope(const char *name);
+
+    // per frame value reported after the passes, such as culled objects.
+    void count(const char *name, double value);
+
+    bool hasGpuTiming() const { return gpuTiming_; }
+
+    // rolling statistics of one pass in milliseconds, zero for a pass never measured.
+    Stats getPassStats(const std::string &name, bool gpu) const;
+
+    // rolling average and max of every pass in milliseconds, nested by depth,
+    // followed by the counters.
+    void report(std::ostream &out) const;
+
+    // chrome://tracing json of the last frames, cpu and gpu on separate rows.
+    void dumpTrace(const std::string &filename) const;
+};
+
+}
@@ -0,0 +1,161 @@
+#include "StdAfx.h"
+#include "ProgramCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+    #include <Windows.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+#include "glog\logging.h"
+
+namespace glsl {
+
+namespace {
+    const std::uint32_t MAGIC = 0x42504c47; // "GLPB"
+
+    struct FileHeader {
+        std::uint32_t magic;
+        std::uint32_t format;
+        std::uint64_t key;
+    };
+
+    // FNV-1a, strings are separated so "ab" + "c" differs from "a" + "bc"
+    std::uint64_t hash(std::uint64_t h, const char *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 1099511628211ull;
+        }
+        h ^= 0xff;
+        h *= 1099511628211ull;
+        return h;
+    }
+
+    std::string getString(GLenum name) {
+        auto value = reinterpret_cast<const char *>(glGetString(name));
+        return value ? value : "";
+    }
+
+    // replaces the target in one step, readers see the old file or the new one
+    bool replaceFile(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+        return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+    }
+
+    void createDirectory(const std::string &directory) {
+#ifdef _WIN32
+        CreateDirectoryA(directory.c_str(), nullptr);
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+}
+
+ProgramCache::ProgramCache(const std::string &directory)
+        : directory_(directory)
+        , hits_(0)
+        , misses_(0)
+        , rejected_(0) {
+    driver_ = getString(GL_VENDOR) + "\n" + getString(GL_RENDERER) + "\n" + getString(GL_VERSION);
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    supported_ = formats > 0;
+    if (!supported_) {
+        LOG(WARNING) << "Driver has no program binary formats, programs are compiled every run";
+        return;
+    }
+    createDirectory(directory_);
+}
+
+std::string ProgramCache::getFilename(std::uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return directory_ + name;
+}
+
+std::uint64_t ProgramCache::computeKey(const std::vector<const std::vector<std::string> *> &stages) const {
+    auto key = hash(14695981039346656037ull, driver_.data(), driver_.size());
+    for (auto stage : stages) {
+        for (const auto &source : *stage) {
+            key = hash(key, source.data(), source.size());
+        }
+        key = hash(key, nullptr, 0);
+    }
+    return key;
+}
+
+GLuint ProgramCache::load(std::uint64_t key) {
+    if (!supported_) {
+        return 0;
+    }
+
+    std::ifstream in(getFilename(key), std::ios::binary);
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))
+            || header.magic != MAGIC || header.key != key) {
+        misses_++;
+        return 0;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    auto program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        // after driver updates that keep the version string, for instance
+        LOG(WARNING) << "Driver rejected cached program " << getFilename(key);
+        glDeleteProgram(program);
+        rejected_++;
+        return 0;
+    }
+    hits_++;
+    return program;
+}
+
+void ProgramCache::store(std::uint64_t key, GLuint program) {
+    if (!supported_) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    FileHeader header = { MAGIC, 0, key };
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+    header.format = format;
+
+    // written aside first, so a crash or another instance never leaves a torn file behind
+    auto filename = getFilename(key);
+    auto temporary = filename + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(binary.data(), binary.size());
+        out.close();
+        if (!out) {
+            LOG(WARNING) << "Cannot write " << temporary;
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+    if (!replaceFile(temporary, filename)) {
+        LOG(WARNING) << "Cannot replace " << filename;
+        std::remove(temporary.c_str());
+    }
+}
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <GL\glew.h>
+
+namespace glsl {
+
+/**
+* Linked program binaries on disk, one file per program. Files are named by
+* a hash of every source string and the driver, so a new driver or an edited
+* shader misses instead of loading a stale binary. Drivers may still reject
+* a binary, the program is compiled from source then and the file replaced.
+*/
+class ProgramCache
+{
+    const std::string directory_;
+    std::string driver_;
+    bool supported_;
+
+    int hits_;
+    int misses_;
+    int rejected_;
+
+    std::string getFilename(std::uint64_t key) const;
+
+public:
+    // needs a current context, creates directory when it does not exist.
+    explicit ProgramCache(const std::string &directory);
+
+    ProgramCache(const ProgramCache &) = delete;
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    // drivers without binary formats never hit.
+    bool isSupported() const { return supported_; }
+
+    // sources are every string passed to glShaderSource, stage by stage.
+    std::uint64_t computeKey(const std::vector<const std::vector<std::string> *> &stages) const;
+
+    // program linked from the cached binary, 0 if there is none or it was rejected.
+    GLuint load(std::uint64_t key);
+
+    // program must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+    void store(std::uint64_t key, GLuint program);
+
+    int getHits() const { return hits_; }
+    int getMisses() const { return misses_; }
+    int getRejected() const { return rejected_; }
+};
+
+}
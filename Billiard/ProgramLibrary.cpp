@@ -0,0 +1,125 @@
+#include "StdAfx.h"
+#include "ProgramLibrary.h"
+
+#include <stdexcept>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+ProgramVariants::ProgramVariants(const std::vector<std::string> &files, const std::vector<std::string> &sources,
+        const std::vector<std::string> &flags, Setup setup)
+        : files_(files)
+        , sources_(sources)
+        , flags_(flags)
+        , setup_(setup)
+        , reloader_(nullptr) {
+    if (sources_.size() != 2 && sources_.size() != 4) {
+        throw std::runtime_error("A program needs 2 or 4 shader sources");
+    }
+}
+
+std::string ProgramVariants::getDefines(unsigned flags) const {
+    std::string defines;
+    for (size_t i = 0; i < flags_.size(); i++) {
+        if (flags & (1u << i)) {
+            defines += "#define " + flags_[i] + "\n";
+        }
+    }
+    return defines;
+}
+
+ProgramVariants::Variant &ProgramVariants::create(unsigned flags) {
+    auto found = variants_.find(flags);
+    if (found != variants_.end()) {
+        return found->second;
+    }
+    if (flags >> flags_.size()) {
+        throw std::runtime_error("Unknown flags for " + files_.back());
+    }
+
+    auto defines = getDefines(flags);
+    auto &variant = variants_[flags];
+    if (sources_.size() == 4) {
+        variant.program.reset(new glsl::Program(defines, sources_[0], sources_[1], sources_[2], sources_[3]));
+    } else {
+        variant.program.reset(new glsl::Program(defines, sources_[0], sources_[1]));
+    }
+    variant.setUp = false;
+    if (reloader_) {
+        watch(variant, flags);
+    }
+    return variant;
+}
+
+glsl::Program &ProgramVariants::get(unsigned flags) {
+    auto &variant = create(flags);
+    if (!variant.setUp) {
+        if (setup_) {
+            setup_(*variant.program, flags);
+        }
+        variant.setUp = true;
+    }
+    return *variant.program;
+}
+
+void ProgramVariants::finish() const {
+    for (const auto &entry : variants_) {
+        entry.second.program->finish();
+    }
+}
+
+void ProgramVariants::watch(Variant &variant, unsigned flags) {
+    // the map never drops variants, so the reference stays valid
+    reloader_->add(*variant.program, getDefines(flags), files_,
+            [this, &variant, flags] (const std::vector<std::string> &sources) {
+        sources_ = sources;
+        if (setup_) {
+            setup_(*variant.program, flags);
+        }
+        variant.setUp = true;
+    });
+}
+
+void ProgramVariants::watch(ShaderReloader &reloader) {
+    reloader_ = &reloader;
+    for (auto &entry : variants_) {
+        watch(entry.second, entry.first);
+    }
+}
+
+ProgramVariants &ProgramLibrary::add(const std::string &name, AssetLoader &assets,
+        const std::vector<std::string> &files, const std::vector<std::string> &flags,
+        ProgramVariants::Setup setup) {
+    auto found = templates_.find(name);
+    if (found != templates_.end()) {
+        return *found->second;
+    }
+
+    std::vector<std::string> sources;
+    for (const auto &file : files) {
+        sources.push_back(assets.text(file).get());
+    }
+    std::unique_ptr<ProgramVariants> variants(new ProgramVariants(files, sources, flags, setup));
+    if (reloader_) {
+        variants->watch(*reloader_);
+    }
+    auto &added = *variants;
+    templates_[name] = std::move(variants);
+    return added;
+}
+
+void ProgramLibrary::watch(ShaderReloader &reloader) {
+    reloader_ = &reloader;
+    for (auto &entry : templates_) {
+        entry.second->watch(reloader);
+    }
+}
+
+void ProgramLibrary::finish() const {
+    for (const auto &entry : templates_) {
+        entry.second->finish();
+    }
+}
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "GlslProgram.h"
+#include "AssetLoader.h"
+#include "ShaderReloader.h"
+
+namespace billiard {
+
+/**
+* One program template, its shader sources plus the feature flags they
+* know about, and the variants built from it so far. A variant is keyed by
+* the bitmask of its flags, flag N becomes "#define <name N>" in front of
+* the sources, and is compiled the first time someone asks for it.
+*/
+class ProgramVariants
+{
+public:
+    // runs on every variant before it is handed out, and again after a reload.
+    typedef std::function<void(glsl::Program &program, unsigned flags)> Setup;
+
+private:
+    struct Variant {
+        std::unique_ptr<glsl::Program> program;
+        bool setUp;
+    };
+
+    const std::vector<std::string> files_;
+    // last sources that built, variants asked for after a reload start from the edited files
+    std::vector<std::string> sources_;
+    const std::vector<std::string> flags_;
+    const Setup setup_;
+    std::unordered_map<unsigned, Variant> variants_;
+    ShaderReloader *reloader_;
+
+    Variant &create(unsigned flags);
+    void watch(Variant &variant, unsigned flags);
+
+public:
+    ProgramVariants(const std::vector<std::string> &files, const std::vector<std::string> &sources,
+            const std::vector<std::string> &flags, Setup setup);
+
+    ProgramVariants(const ProgramVariants &) = delete;
+    ProgramVariants &operator=(const ProgramVariants &) = delete;
+
+    std::string getDefines(unsigned flags) const;
+
+    // submits the variant for compiling without waiting for it.
+    void prepare(unsigned flags) { create(flags); }
+
+    // compiles and sets the variant up on first use.
+    glsl::Program &get(unsigned flags);
+
+    // waits for every variant submitted so far, throws if one did not build.
+    void finish() const;
+
+    // variants built so far and later ones are rebuilt when their files change.
+    void watch(ShaderReloader &reloader);
+};
+
+/**
+* Program templates by name, so objects asking for the same template share
+* its variants instead of compiling their own copies.
+*/
+class ProgramLibrary
+{
+    std::unordered_map<std::string, std::unique_ptr<ProgramVariants>> templates_;
+    ShaderReloader *reloader_;
+
+public:
+    ProgramLibrary() : reloader_(nullptr) {}
+
+    ProgramLibrary(const ProgramLibrary &) = delete;
+    ProgramLibrary &operator=(const ProgramLibrary &) = delete;
+
+    /*
+        files are vertex, tess control and eval if any, and fragment shader,
+        relative to the assets directory. Returns the template already
+        added under name, if any.
+    */
+    ProgramVariants &add(const std::string &name, AssetLoader &assets, const std::vector<std::string> &files,
+            const std::vector<std::string> &flags, ProgramVariants::Setup setup = ProgramVariants::Setup());
+
+    void watch(ShaderReloader &reloader);
+
+    /*
+        Checks every variant submitted so far, so a broken shader fails
+        where the programs are set up instead of in the first frame.
+    */
+    void finish() const;
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+namespace billiard {
+
+/**
+* Seeded generator (splitmix64) with its own float mapping. Unlike
+* std::random_device and the std distributions, its output is the same on
+* every platform and standard library, so seeded runs can be replayed.
+*/
+class Random
+{
+    std::uint64_t state_;
+
+public:
+    explicit Random(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t next() {
+        auto z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [min, max), top 24 bits give every float step in [0, 1).
+    float uniform(float min, float max) {
+        auto unit = static_cast<float>(next() >> 40) / (1 << 24);
+        return min + (max - min) * unit;
+    }
+};
+
+}
@@ -0,0 +1,352 @@
+#include "StdAfx.h"
+#include "SelfTest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "glog\logging.h"
+
+#include "BallKernels.h"
+#include "BallSystem.h"
+#include "Clock.h"
+#include "EventSolver.h"
+#include "ShotEvaluator.h"
+#include "SimulationThread.h"
+#include "TripleBuffer.h"
+
+namespace billiard {
+
+namespace {
+    struct Report {
+        int checks;
+        int failed;
+
+        void expect(bool condition, const std::string &what) {
+            checks++;
+            if (!condition) {
+                LOG(ERROR) << "self test failed: " << what;
+                failed++;
+            }
+        }
+    };
+
+    float maxDistance(const BallSystem &a, const BallSystem &b) {
+        float result = 0;
+        for (int i = 0; i < a.count(); i++) {
+            result = std::max(result, glm::length(a.position(i) - b.position(i)));
+        }
+        return result;
+    }
+
+    // object balls in two rows at the bottom left, out of the way of the shots below.
+    void clearTable(BallSystem &balls) {
+        balls.rack();
+        for (int i = 1; i < balls.count(); i++) {
+            balls.place(i, glm::vec2(-4.5f + (i - 1) % 8 * 0.7f, -4.5f + (i - 1) / 8 * 0.7f));
+        }
+    }
+
+    // a cue ball hits ball 1, which hits a cushion: the solver must see the
+    // impacts in order, so it ends where tiny fixed steps do.
+    void testEventOrder(Report &report) {
+        BallSystem events;
+        clearTable(events);
+        events.place(0, glm::vec2(0.5f, -3));
+        events.place(1, glm::vec2(0.7f, 0));
+        events.strike(0, glm::vec2(0, 8), glm::vec3(0));
+
+        BallSystem steps = events;
+        EventSolver solver;
+        auto count = solver.simulate(events, 30);
+        for (int i = 0; i < 30 * 100000 && steps.isMoving(); i++) {
+            steps.step(1e-5f);
+        }
+
+        report.expect(count >= 3, "event order: expected a collision and cushion hits, got "
+                      + std::to_string(count) + " events");
+        report.expect(maxDistance(events, steps) < 0.02f, "event order: ended "
+                      + std::to_string(maxDistance(events, steps)) + " away from fixed steps");
+    }
+
+    // a ball struck between two advances must get its events predicted again,
+    // the kept queue has none for it since it was at rest.
+    void testInvalidation(Report &report) {
+        BallSystem kept;
+        clearTable(kept);
+        kept.place(0, glm::vec2(0.5f, -3));
+        kept.place(1, glm::vec2(0.5f, 0));
+        BallSystem fresh = kept;
+
+        const float step = 1.0f / 60;
+        EventSolver solver;
+        for (int frame = 0; frame < 600; frame++) {
+            if (frame == 10) {
+                kept.strike(0, glm::vec2(0, 8), glm::vec3(0));
+                fresh.strike(0, glm::vec2(0, 8), glm::vec3(0));
+            }
+            solver.advance(kept, step);
+
+            // what the solver did before it kept its queue
+            EventSolver once;
+            once.advance(fresh, step);
+        }
+
+        report.expect(glm::length(kept.position(1) - glm::vec2(0.5f, 0)) > 1,
+                      "invalidation: ball 1 was never hit");
+        report.expect(maxDistance(kept, fresh) < 1e-3f, "invalidation: kept queue ended "
+                      + std::to_string(maxDistance(kept, fresh)) + " away from rebuilt queues");
+    }
+
+    // the break stepped like the game does stays cheap for the event solver.
+    void testBreakEvents(Report &report) {
+        BallSystem balls;
+        balls.rack();
+        balls.strike(0, glm::vec2(0.02f, 1) * 40.0f, glm::vec3(0));
+
+        EventSolver solver;
+        int total = 0;
+        int maxPerStep = 0;
+        for (int i = 0; i < 60 * 60 && balls.isMoving(); i++) {
+            auto count = solver.advance(balls, 1.0f / 60);
+            total += count;
+            maxPerStep = std::max(maxPerStep, count);
+        }
+
+        report.expect(!balls.isMoving(), "break: balls still move after a minute");
+        report.expect(total < 200, "break: " + std::to_string(total) + " events, expected under 200");
+        std::cout << "break: " << total << " events, at most " << maxPerStep << " per step" << std::endl;
+    }
+
+    struct alignas(32) KernelState {
+        float posX[BallSystem::MAX_BALLS];
+        float posY[BallSystem::MAX_BALLS];
+        float velX[BallSystem::MAX_BALLS];
+        float velY[BallSystem::MAX_BALLS];
+        float angX[BallSystem::MAX_BALLS];
+        float angY[BallSystem::MAX_BALLS];
+        float angZ[BallSystem::MAX_BALLS];
+
+        kernels::BallArrays arrays(int count) {
+            kernels::BallArrays result = { posX, posY, velX, velY, angX, angY, angZ, count };
+            return result;
+        }
+
+        // padding past count is the kernels' to use, it is not compared
+        bool equals(const KernelState &other, int count) const {
+            const float *arrays[] = { posX, posY, velX, velY, angX, angY, angZ };
+            const float *otherArrays[] = { other.posX, other.posY, other.velX, other.velY,
+                                           other.angX, other.angY, other.angZ };
+            for (int k = 0; k < 7; k++) {
+                if (std::memcmp(arrays[k], otherArrays[k], count * sizeof(float)) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    // packed kernels give the scalar results bit for bit, at any ball count.
+    void testKernelParity(Report &report) {
+        std::vector<const kernels::Kernels *> sets;
+        auto isa = kernels::detectIsa();
+        if (isa == kernels::Isa::Sse || isa == kernels::Isa::Avx2) {
+            sets.push_back(&kernels::sseKernels());
+        }
+        if (isa == kernels::Isa::Avx2) {
+            sets.push_back(&kernels::avx2Kernels());
+        }
+
+        unsigned int seed = 1;
+        auto next = [&seed]() {
+            seed = seed * 1664525u + 1013904223u;
+            return static_cast<float>(seed >> 8) / (1 << 24) - 0.5f;
+        };
+
+        for (auto set : sets) {
+            int integrateDiffs = 0;
+            int contactDiffs = 0;
+            for (int trial = 0; trial < 200; trial++) {
+                auto count = 1 + trial % BallSystem::MAX_BALLS;
+                KernelState scalar;
+                auto *values = &scalar.posX[0];
+                for (size_t k = 0; k < sizeof(scalar) / sizeof(float); k++) {
+                    values[k] = next() * 20;
+                }
+                auto packed = scalar;
+
+                // slow balls stop within the step, fast ones keep sliding
+                auto dt = trial % 2 ? 1.0f / 60 : 1e-3f;
+                for (int step = 0; step < 20; step++) {
+                    kernels::scalarKernels().integrate(scalar.arrays(count), dt);
+                    set->integrate(packed.arrays(count), dt);
+                }
+                integrateDiffs += !scalar.equals(packed, count);
+
+                // crowded, so most pairs are near the threshold
+                for (int i = 0; i < count; i++) {
+                    scalar.posX[i] = next() * BALL_DIAMETER * 3;
+                    scalar.posY[i] = next() * BALL_DIAMETER * 3;
+                }
+                unsigned short expected[BallSystem::MAX_BALLS];
+                unsigned short actual[BallSystem::MAX_BALLS];
+                auto expectedPairs = kernels::scalarKernels().findContacts(scalar.posX, scalar.posY, count,
+                                                                           BALL_DIAMETER, expected);
+                auto actualPairs = set->findContacts(scalar.posX, scalar.posY, count, BALL_DIAMETER, actual);
+                contactDiffs += expectedPairs != actualPairs
+                                || std::memcmp(expected, actual, count * sizeof(expected[0])) != 0;
+            }
+            report.expect(integrateDiffs == 0, std::string(set->name) + " kernels: integration differs from scalar in "
+                          + std::to_string(integrateDiffs) + " of 200 states");
+            report.expect(contactDiffs == 0, std::string(set->name) + " kernels: contacts differ from scalar in "
+                          + std::to_string(contactDiffs) + " of 200 states");
+        }
+    }
+
+    // a fixed step leaves no pair of a squeezed row overlapping.
+    void testContactPasses(Report &report) {
+        BallSystem balls;
+        clearTable(balls);
+        for (int i = 0; i < 4; i++) {
+            balls.place(i, glm::vec2(i * BALL_DIAMETER * 0.9f, 2));
+        }
+        balls.step(0);
+
+        float overlap = 0;
+        for (int i = 0; i < balls.count(); i++) {
+            for (int j = i + 1; j < balls.count(); j++) {
+                overlap = std::max(overlap, BALL_DIAMETER - glm::length(balls.position(j) - balls.position(i)));
+            }
+        }
+        report.expect(overlap < BALL_DIAMETER * 0.01f, "contacts: balls still overlap by "
+                      + std::to_string(overlap) + " after a step");
+    }
+
+    // shots evaluated on the pool end as they do one after another.
+    void testShotEvaluator(Report &report) {
+        BallSystem table;
+        table.rack();
+        std::vector<Shot> shots;
+        for (int i = 0; i < 64; i++) {
+            shots.push_back(Shot { 0, glm::vec2(0.01f * i, 1) * 30.0f, glm::vec3(0) });
+        }
+
+        ShotEvaluator evaluator(4);
+        auto results = evaluator.evaluate(table, shots);
+
+        int differ = 0;
+        for (size_t i = 0; i < shots.size(); i++) {
+            auto balls = table;
+            balls.strike(shots[i].ball, shots[i].velocity, shots[i].spin);
+            EventSolver solver;
+            solver.simulate(balls, 60);
+            differ += balls.hash() != results[i].hash();
+        }
+        report.expect(differ == 0, "shot evaluator: " + std::to_string(differ) + " shots differ from serial runs");
+    }
+
+    bool near(double a, double b) {
+        return std::fabs(a - b) < 1e-6;
+    }
+
+    // leftover time becomes alpha, time past the catch-up cap is dropped.
+    void testClock(Report &report) {
+        Clock clock(0.01, 5);
+        auto steps = clock.advance(0.025);
+        report.expect(steps == 2 && near(clock.getAlpha(), 0.5), "clock: 25 ms gave " + std::to_string(steps)
+                      + " steps, alpha " + std::to_string(clock.getAlpha()));
+
+        steps = clock.advance(0.004);
+        report.expect(steps == 0 && near(clock.getAlpha(), 0.9), "clock: alpha "
+                      + std::to_string(clock.getAlpha()) + " after 4 more ms");
+
+        // 109 ms due, 5 steps run, all but the leftover 9 ms of the rest is dropped
+        steps = clock.advance(0.1);
+        report.expect(steps == 5 && clock.getSteps() == 7, "clock: " + std::to_string(steps) + " steps after a stall");
+        report.expect(near(clock.getDroppedTime(), 0.05) && near(clock.getAlpha(), 0.9),
+                      "clock: dropped " + std::to_string(clock.getDroppedTime()) + " s, alpha "
+                      + std::to_string(clock.getAlpha()) + " after a stall");
+    }
+
+    // a reader polling as fast as it can sees whole values, newer each time,
+    // and the last one published.
+    void testTripleBuffer(Report &report) {
+        const int count = 200000;
+        TripleBuffer<std::pair<int, int>> buffer;
+        std::thread writer([&buffer]() {
+            for (int i = 1; i <= count; i++) {
+                buffer.back() = std::make_pair(i - 1, i);
+                buffer.publish();
+            }
+        });
+
+        int last = 0;
+        int torn = 0;
+        int older = 0;
+        while (last < count) {
+            if (!buffer.update()) {
+                continue;
+            }
+            auto value = buffer.front();
+            torn += value.first + 1 != value.second;
+            older += value.second <= last;
+            last = value.second;
+        }
+        writer.join();
+
+        report.expect(torn == 0, "triple buffer: " + std::to_string(torn) + " torn values");
+        report.expect(older == 0, "triple buffer: " + std::to_string(older) + " values not newer than the one before");
+        report.expect(!buffer.update(), "triple buffer: fresh value after the last one was read");
+    }
+
+    // the render thread gets consecutive steps and an alpha between them.
+    void testSnapshotHandover(Report &report) {
+        BallSystem balls;
+        balls.rack();
+        SimulationThread simulation(balls, 1.0f / 120);
+        simulation.strike(Shot { 0, glm::vec2(0.02f, 1) * 40.0f, glm::vec3(0) });
+
+        BallSnapshot previous, latest;
+        int polls = 0;
+        int apart = 0;
+        int outside = 0;
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+        while (std::chrono::steady_clock::now() < end) {
+            if (simulation.poll(previous, latest) && latest.step > 0) {
+                polls++;
+                apart += previous.step + 1 != latest.step;
+            }
+            auto alpha = simulation.getAlpha();
+            outside += alpha < 0 || alpha > 1;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        report.expect(polls > 10, "snapshot hand-over: only " + std::to_string(polls) + " steps in 300 ms");
+        report.expect(apart == 0, "snapshot hand-over: " + std::to_string(apart) + " pairs not one step apart");
+        report.expect(outside == 0, "snapshot hand-over: alpha out of 0..1");
+    }
+}
+
+int runSelfTests() {
+    Report report = { 0, 0 };
+    testEventOrder(report);
+    testInvalidation(report);
+    testBreakEvents(report);
+    testKernelParity(report);
+    testContactPasses(report);
+    testShotEvaluator(report);
+    testClock(report);
+    testTripleBuffer(report);
+    testSnapshotHandover(report);
+
+    std::cout << report.checks - report.failed << " of " << report.checks << " checks passed" << std::endl;
+    return report.failed;
+}
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace billiard {
+
+/**
+* Checks of the parts that run without a window or a GL context: the event
+* solver against fixed steps and against itself, packed kernels against
+* scalar ones, and the snapshot hand-over between the simulation and render
+* threads and the Clock pacing them. Failures are logged, the result is the
+* number of them.
+*/
+int runSelfTests();
+
+}
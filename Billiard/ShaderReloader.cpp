@@ -0,0 +1,83 @@
+#include "StdAfx.h"
+#include "ShaderReloader.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+namespace {
+    const char *const SHADERS = "shaders/";
+}
+
+ShaderReloader::ShaderReloader(const std::string &root)
+        : root_(root)
+        , watcher_(root + SHADERS) {
+}
+
+void ShaderReloader::add(glsl::Program &program, const std::string &defines,
+        const std::vector<std::string> &files, Callback reloaded) {
+    if (files.size() != 2 && files.size() != 4) {
+        throw std::runtime_error("A program needs 2 or 4 shader files");
+    }
+    Variant variant;
+    variant.program = &program;
+    variant.defines = defines;
+    variant.files = files;
+    variant.reloaded = reloaded;
+    variants_.push_back(std::move(variant));
+}
+
+void ShaderReloader::rebuild(Variant &variant) {
+    std::vector<std::string> sources;
+    try {
+        for (const auto &file : variant.files) {
+            sources.push_back(glsl::loadShaderFromFile(root_ + file));
+        }
+    } catch (const std::exception &) {
+        // being replaced right now, the next event brings the new file
+        return;
+    }
+
+    // a newer edit replaces a rebuild still in flight
+    if (sources.size() == 4) {
+        variant.pending.reset(new glsl::Program(variant.defines, sources[0], sources[1], sources[2], sources[3]));
+    } else {
+        variant.pending.reset(new glsl::Program(variant.defines, sources[0], sources[1]));
+    }
+    variant.pendingSources = std::move(sources);
+}
+
+void ShaderReloader::update() {
+    for (const auto &name : watcher_.poll()) {
+        auto file = SHADERS + name;
+        for (auto &variant : variants_) {
+            if (std::find(variant.files.begin(), variant.files.end(), file) != variant.files.end()) {
+                rebuild(variant);
+            }
+        }
+    }
+
+    for (auto &variant : variants_) {
+        if (!variant.pending || !variant.pending->isReady()) {
+            continue;
+        }
+        try {
+            variant.pending->finish();
+        } catch (const std::runtime_error &e) {
+            LOG(ERROR) << e.what() << " in " << variant.files.back() << ", keeping the old program";
+            variant.pending.reset();
+            continue;
+        }
+        variant.program->swap(*variant.pending);
+        variant.pending.reset();
+        if (variant.reloaded) {
+            variant.reloaded(variant.pendingSources);
+        }
+        LOG(INFO) << "Reloaded " << variant.files.front() << " + " << variant.files.back();
+    }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GlslProgram.h"
+#include "FileWatcher.h"
+
+namespace billiard {
+
+/**
+* Rebuilds programs whose shader files change on disk. Each registered
+* program is one variant, its files plus the defines it was built with, so
+* an edit of sphere.tese rebuilds the shadow, depth and normal ball programs
+* and nothing else. Rebuilds are submitted without waiting for the driver,
+* a rebuilt program takes the place of the old one once it is ready and a
+* failed one is dropped, leaving the old program in use.
+*/
+class ShaderReloader
+{
+public:
+    // gets the sources the new program was built from, in the order of its files.
+    typedef std::function<void(const std::vector<std::string> &sources)> Callback;
+
+private:
+    struct Variant {
+        glsl::Program *program;
+        std::string defines;
+        // vertex, tess control and eval if any, fragment, relative to the assets directory
+        std::vector<std::string> files;
+        Callback reloaded;
+        std::unique_ptr<glsl::Program> pending;
+        std::vector<std::string> pendingSources;
+    };
+
+    const std::string root_;
+    FileWatcher watcher_;
+    std::vector<Variant> variants_;
+
+    void rebuild(Variant &variant);
+
+public:
+    // root is the assets directory, its shaders directory is watched.
+    explicit ShaderReloader(const std::string &root);
+
+    ShaderReloader(const ShaderReloader &) = delete;
+    ShaderReloader &operator=(const ShaderReloader &) = delete;
+
+    /*
+        program must outlive the reloader. reloaded runs after every swap,
+        it sets samplers and refreshes locations cached from the program.
+    */
+    void add(glsl::Program &program, const std::string &defines, const std::vector<std::string> &files,
+            Callback reloaded = Callback());
+
+    // on the GL thread once per frame, before anything is drawn.
+    void update();
+};
+
+}
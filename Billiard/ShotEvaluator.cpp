@@ -0,0 +1,49 @@
+#include "StdAfx.h"
+#include "ShotEvaluator.h"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace billiard {
+
+namespace {
+    // chunks per worker, more chunks balance better but cost more queueing.
+    const int CHUNKS_PER_WORKER = 8;
+}
+
+// results sit in a plain std::vector, which only guarantees the default alignment.
+static_assert(alignof(BallSystem) <= alignof(std::max_align_t), "BallSystem must not be over-aligned");
+
+ShotEvaluator::ShotEvaluator(int threads)
+        : pool_(threads)
+        , scratch_(pool_.size())
+        , maxTime_(60) {
+}
+
+std::vector<BallSystem> ShotEvaluator::evaluate(const BallSystem &table, const std::vector<Shot> &shots) {
+    std::vector<BallSystem> results;
+    evaluate(table, shots, results);
+    return results;
+}
+
+void ShotEvaluator::evaluate(const BallSystem &table, const std::vector<Shot> &shots,
+        std::vector<BallSystem> &results) {
+    auto count = static_cast<int>(shots.size());
+    results.assign(count, table);
+
+    auto chunk = std::max(1, count / (pool_.size() * CHUNKS_PER_WORKER));
+    for (int begin = 0; begin < count; begin += chunk) {
+        auto end = std::min(count, begin + chunk);
+        pool_.submit([this, &shots, &results, begin, end](int worker) {
+            auto &solver = scratch_[worker].solver;
+            for (int i = begin; i < end; i++) {
+                const auto &shot = shots[i];
+                results[i].strike(shot.ball, shot.velocity, shot.spin);
+                solver.simulate(results[i], maxTime_);
+            }
+        });
+    }
+    pool_.wait();
+}
+
+}
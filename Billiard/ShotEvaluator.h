@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <glm\glm.hpp>
+
+#include "AlignedAllocator.h"
+#include "BallSystem.h"
+#include "EventSolver.h"
+#include "ThreadPool.h"
+
+namespace billiard {
+
+struct Shot {
+    int ball;
+    glm::vec2 velocity; // right after the cue hit
+    glm::vec3 spin;
+};
+
+/**
+* Simulates many candidate shots from one table state in parallel, without
+* any window or GL context. Each worker thread owns its own solver.
+*/
+class ShotEvaluator
+{
+    // per worker scratch memory, padded so workers do not share cache lines.
+    struct alignas(64) Scratch {
+        EventSolver solver;
+    };
+
+    ThreadPool pool_;
+    std::vector<Scratch, AlignedAllocator<Scratch, 64>> scratch_;
+    float maxTime_;
+
+public:
+    // threads == 0 means one thread per hardware thread.
+    explicit ShotEvaluator(int threads = 0);
+
+    // longest simulated time of a single shot, in seconds.
+    void setMaxTime(float seconds) { maxTime_ = seconds; }
+
+    // final table states in the order of shots.
+    std::vector<BallSystem> evaluate(const BallSystem &table, const std::vector<Shot> &shots);
+    void evaluate(const BallSystem &table, const std::vector<Shot> &shots, std::vector<BallSystem> &results);
+};
+
+}
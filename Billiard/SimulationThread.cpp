@@ -0,0 +1,84 @@
+#include "StdAfx.h"
+#include "SimulationThread.h"
+
+#include <algorithm>
+
+#include "glog\logging.h"
+
+namespace billiard {
+
+SimulationThread::SimulationThread(const BallSystem &balls, float step)
+        : balls_(balls)
+        , step_(step)
+        , start_(std::chrono::steady_clock::now())
+        , clock_(step)
+        , running_(true) {
+    latest_.capture(balls_, 0, 0);
+    auto &published = snapshots_.back();
+    published.previous = latest_;
+    published.latest = latest_;
+    published.time = 0;
+    snapshots_.publish();
+    thread_ = std::thread(&SimulationThread::loop, this);
+}
+
+SimulationThread::~SimulationThread() {
+    running_ = false;
+    thread_.join();
+}
+
+void SimulationThread::strike(const Shot &shot) {
+    std::lock_guard<std::mutex> lock(strikesMutex_);
+    strikes_.push_back(shot);
+}
+
+bool SimulationThread::poll(BallSnapshot &previous, BallSnapshot &latest) {
+    if (!snapshots_.update()) {
+        return false;
+    }
+    previous = snapshots_.front().previous;
+    latest = snapshots_.front().latest;
+    return true;
+}
+
+float SimulationThread::getAlpha() const {
+    auto alpha = (now() - snapshots_.front().time) / step_;
+    return static_cast<float>(std::min(std::max(alpha, 0.0), 1.0));
+}
+
+double SimulationThread::now() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
+void SimulationThread::loop() {
+    while (running_) {
+        auto steps = clock_.advance();
+        for (int i = 0; i < steps; i++) {
+            {
+                std::lock_guard<std::mutex> lock(strikesMutex_);
+                for (const auto &shot : strikes_) {
+                    if (!balls_.isMoving()) {
+                        balls_.strike(shot.ball, shot.velocity, shot.spin);
+                    }
+                }
+                strikes_.clear();
+            }
+
+            solver_.advance(balls_, step_);
+
+            // dropped time is added, so snapshots stay on the wall clock after a stall
+            auto step = clock_.getSteps() - steps + i + 1;
+            auto &published = snapshots_.back();
+            published.previous = latest_;
+            latest_.capture(balls_, step, step * clock_.getStep() + clock_.getDroppedTime());
+            published.latest = latest_;
+            published.time = now();
+            snapshots_.publish();
+        }
+        std::this_thread::sleep_for(clock_.untilNextStep());
+    }
+    LOG(INFO) << "simulation stopped after " << clock_.getSteps() << " steps, "
+              << clock_.getDroppedTime() << " s dropped";
+}
+
+}
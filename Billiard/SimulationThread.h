@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BallSystem.h"
+#include "BallSnapshot.h"
+#include "Clock.h"
+#include "EventSolver.h"
+#include "ShotEvaluator.h"
+#include "TripleBuffer.h"
+
+namespace billiard {
+
+/**
+* Steps its own copy of the balls with a fixed step on a separate thread,
+* paced by Clock, and publishes the two latest snapshots after every step.
+* The render thread reads them without locks and interpolates from one to
+* the other over the step after they were published, so slow steps such as
+* the break shot do not stall frames.
+*/
+class SimulationThread
+{
+    // consecutive steps, handed over together so the reader never pairs
+    // a snapshot with one it happened to poll earlier
+    struct Published {
+        BallSnapshot previous;
+        BallSnapshot latest;
+        double time; // wall clock seconds since start when published
+
+        Published() : time(0) {}
+    };
+
+    // lives on the default heap with the thread, the kernels need no alignment.
+    BallSystem balls_;
+    EventSolver solver_;
+    const float step_;
+
+    TripleBuffer<Published> snapshots_;
+    BallSnapshot latest_; // writer only, becomes previous of the next step
+
+    // strikes from the render thread, applied before the next step.
+    std::mutex strikesMutex_;
+    std::vector<Shot> strikes_;
+
+    std::chrono::steady_clock::time_point start_;
+    Clock clock_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+
+    void loop();
+
+public:
+    SimulationThread(const BallSystem &balls, float step);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread &) = delete;
+    SimulationThread &operator=(const SimulationThread &) = delete;
+
+    // ignored if balls are still moving when the simulation gets to it.
+    void strike(const Shot &shot);
+
+    // render thread: true and the two new snapshots if a step was published.
+    bool poll(BallSnapshot &previous, BallSnapshot &latest);
+
+    // render thread: 0..1 from previous to latest of the last poll, one
+    // step after they were published the render time reaches latest.
+    float getAlpha() const;
+
+    // wall clock seconds since start, on the same scale as BallSnapshot::time.
+    double now() const;
+
+    float getStep() const { return step_; }
+};
+
+}
@@ -0,0 +1,44 @@
+#include "StdAfx.h"
+#include "StateTrace.h"
+
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+namespace billiard {
+
+void StateTrace::save(const std::string &filename) const {
+    std::ofstream out(filename);
+    if (!out) {
+        throw std::runtime_error("Cannot write trace " + filename);
+    }
+    out << std::hex;
+    for (auto hash : hashes_) {
+        out << hash << '\n';
+    }
+}
+
+StateTrace StateTrace::load(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::runtime_error("Cannot read trace " + filename);
+    }
+    StateTrace trace;
+    std::uint64_t hash;
+    while (in >> std::hex >> hash) {
+        trace.hashes_.push_back(hash);
+    }
+    return trace;
+}
+
+int StateTrace::findDivergence(const StateTrace &a, const StateTrace &b) {
+    auto common = std::min(a.size(), b.size());
+    for (int i = 0; i < common; i++) {
+        if (a.hashes_[i] != b.hashes_[i]) {
+            return i;
+        }
+    }
+    return a.size() == b.size() ? -1 : common;
+}
+
+}
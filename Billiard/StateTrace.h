@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BallSystem.h"
+
+namespace billiard {
+
+/**
+* Hashes of BallSystem states, one per simulation step. Two runs of the same
+* replay are compared by their traces, the first differing step tells where
+* they diverged.
+*/
+class StateTrace
+{
+    std::vector<std::uint64_t> hashes_;
+
+public:
+    void record(const BallSystem &balls) { hashes_.push_back(balls.hash()); }
+
+    int size() const { return static_cast<int>(hashes_.size()); }
+    std::uint64_t at(int step) const { return hashes_[step]; }
+
+    // text file, one hex hash per line.
+    void save(const std::string &filename) const;
+    static StateTrace load(const std::string &filename);
+
+    // first step that differs (or exists in one trace only), -1 when equal.
+    static int findDivergence(const StateTrace &a, const StateTrace &b);
+};
+
+}
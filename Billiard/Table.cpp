@@ -3,14 +3,12 @@
 #include "Table.h"
 
 #include "utils.h"
-
-#include <glm\gtc\type_ptr.hpp>
+#include "Dimensions.h"
+#include "Image.h"
+#include "GlState.h"
 
 #include "glog\logging.h"
 
-#define TABLE_WIDTH 10.0f
-#define TABLE_HEIGHT 10.0f
-
 namespace {
     const float vertices[] =  {
         -TABLE_WIDTH / 2, -TABLE_HEIGHT / 2, 0, 0, 0, 1, 0,  0,
@@ -18,17 +16,34 @@ namespace {
          TABLE_WIDTH / 2,  TABLE_HEIGHT / 2, 0, 0, 0, 1, 10, 10,
         -TABLE_WIDTH / 2,  TABLE_HEIGHT / 2, 0, 0, 0, 1, 0,  10
     };
+
+    const char *const VERTEX_SHADER = "shaders/table.vert";
+    const char *const FRAGMENT_SHADER = "shaders/table.frag";
+    const char *const TEXTURE = "textures/pool.png";
+    const char *const PROGRAM = "table";
+
+    const unsigned DEPTH_PASS = 1 << 0;
+
+    void setupProgram(glsl::Program &program, unsigned flags) {
+        if (flags == 0) {
+            program.bind();
+            program.setUniformInt("u_ShadowMap", 0);
+            program.setUniformInt("u_Texture", 1);
+            glsl::Program::unbind();
+        }
+    }
 }
 
 namespace billiard {
 
-Table::Table(const std::string &exePath) 
-        : program_("", 
-                   glsl::loadShaderFromFile(exePath + "../assets/shaders/table.vert"), 
-                   glsl::loadShaderFromFile(exePath + "../assets/shaders/table.frag"))
-        , depth_("#define DEPTH_PASS\n",
-                 glsl::loadShaderFromFile(exePath + "../assets/shaders/table.vert"), 
-                 glsl::loadShaderFromFile(exePath + "../assets/shaders/table.frag"))
+void Table::requestAssets(AssetLoader &assets) {
+    assets.text(VERTEX_SHADER);
+    assets.text(FRAGMENT_SHADER);
+    assets.image(TEXTURE);
+}
+
+Table::Table(AssetLoader &assets, ProgramLibrary &programs)
+        : programs_(programs.add(PROGRAM, assets, { VERTEX_SHADER, FRAGMENT_SHADER }, { "DEPTH_PASS" }, setupProgram))
         , vbo_(VertexBuffer::create<GL_ARRAY_BUFFER>(vertices, utils::length(vertices)))
 {
     glBindVertexArray(vao_);
@@ -46,57 +61,31 @@ Table::Table(const std::string &exePath)
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
-    unsigned int w, h, bpp;
-    auto textureFile = exePath + "../assets/textures/pool.png";
-    auto data = utils::loadPng(textureFile.c_str(), &w, &h, &bpp);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+    image::Uploader uploader;
+    uploader.upload2D(assets.image(TEXTURE).get());
+    image::Uploader::finish();
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    programs_.prepare(DEPTH_PASS);
+    programs_.prepare(0);
 }
 
-void Table::renderDepth(const Frustum &frustum) {
-    const auto view = frustum.getView();
-
-    depth_.bind();
-    depth_.setUniformMat4("u_ModelviewProjectionMat", false, frustum.getViewProjPtr());
-    depth_.setUniformMat4("u_ModelviewMat", false, glm::value_ptr(view)); // view is equal to modelView.
-    depth_.setUniformFloat("u_NearPlane", frustum.getNear());
-    depth_.setUniformFloat("u_FarPlane", frustum.getFar());
-    
-    glDisable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glBindVertexArray(vao_);
+void Table::renderDepth() {
+    programs_.get(DEPTH_PASS).bind();
+    GlState::setEnabled(GL_CULL_FACE, false);
+    GlState::cullFace(GL_BACK);
+    GlState::bindVertexArray(vao_);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindVertexArray(0);
-    glsl::Program::unbind();
 }
 
-void Table::render(const Frustum &frustum, const ConeLight &light, 
-        const Texture &shadowMap) {
-    const auto view = frustum.getView();
-
-    auto depthBiasProjViewMat = utils::biasMatrix * light.computeProjViewMat();
-    auto normalMat = glm::transpose(glm::inverse(glm::mat3(view)));
-
-    program_.bind();
-    program_.setUniformMat4("u_ModelviewProjectionMat", false, frustum.getViewProjPtr());
-    program_.setUniformMat4("u_ModelviewMat", false, glm::value_ptr(view)); // view is equal to modelView.
-    program_.setUniformMat4("u_DepthBiasMat", false, glm::value_ptr(depthBiasProjViewMat));
-    program_.setUniformMat3("u_NormalMat", false, glm::value_ptr(normalMat));
-    
-    program_.setUniformInt("u_ShadowMap", 0);
-    program_.setUniformInt("u_Texture", 1);
-    light.bind(program_, frustum);
-    
-    glCullFace(GL_BACK);
-    glBindVertexArray(vao_);
-    shadowMap.bind<GL_TEXTURE_2D>();
-    glActiveTexture(GL_TEXTURE1);
-    texture_.bind<GL_TEXTURE_2D>();
-    glActiveTexture(GL_TEXTURE0);
+void Table::render(const Texture &shadowMap) {
+    programs_.get(0).bind();
+    GlState::cullFace(GL_BACK);
+    GlState::bindVertexArray(vao_);
+    GlState::bindTexture(0, GL_TEXTURE_2D, shadowMap);
+    GlState::bindTexture(1, GL_TEXTURE_2D, texture_);
 
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    glBindVertexArray(0);
-    glsl::Program::unbind();
 }
 
 }
\ No newline at end of file
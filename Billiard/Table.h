@@ -7,26 +7,28 @@
 #include "GlslProgram.h"
 #include "VertexBuffer.h"
 #include "VertexArray.h"
-#include "Frustum.h"
-#include "ConeLight.h"
 #include "Texture.h"
+#include "AssetLoader.h"
+#include "ProgramLibrary.h"
 
 namespace billiard {
 
 class Table
 {
+    ProgramVariants &programs_; // shared through the library
     const VertexArray vao_;
     const VertexBuffer vbo_;
-    const glsl::Program program_;
-    const glsl::Program depth_;
     const Texture texture_;
 public:
-    Table(const std::string &exePath);
+    Table(AssetLoader &assets, ProgramLibrary &programs);
 
-    void render(const Frustum &frustum, const ConeLight &light, 
-        const Texture &shadowMap);
+    // starts loading what the constructor needs.
+    static void requestAssets(AssetLoader &assets);
 
-    void renderDepth(const Frustum &frustum);
+    // camera and light come from FrameUniforms.
+    void render(const Texture &shadowMap);
+
+    void renderDepth();
 };
 
 }
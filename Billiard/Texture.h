@@ -26,7 +26,7 @@ class Texture
 
     template <GLenum target>
     static void checkTarget() {
-        static_assert(target == GL_TEXTURE_2D || target == GL_TEXTURE_RECTANGLE, 
+        static_assert(target == GL_TEXTURE_2D || target == GL_TEXTURE_RECTANGLE || target == GL_TEXTURE_2D_ARRAY, 
             "wrong target");
     };
 public:
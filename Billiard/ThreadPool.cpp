@@ -0,0 +1,98 @@
+#include "StdAfx.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace billiard {
+
+ThreadPool::ThreadPool(int threads)
+        : queued_(0)
+        , pending_(0)
+        , next_(0)
+        , stopping_(false) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < threads; i++) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (int i = 0; i < threads; i++) {
+        threads_.push_back(std::thread(&ThreadPool::loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    auto &queue = *queues_[next_++ % queues_.size()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_++;
+        pending_++;
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+bool ThreadPool::tryPop(int worker, Task &task) {
+    auto count = static_cast<int>(queues_.size());
+    for (int k = 0; k < count; k++) {
+        auto &queue = *queues_[(worker + k) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        // own queue is used as FIFO, others are robbed from the back
+        if (k == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        queued_--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::loop(int worker) {
+    for (;;) {
+        Task task;
+        if (tryPop(worker, task)) {
+            task(worker);
+            if (--pending_ == 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                done_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace billiard {
+
+/**
+* Fixed set of worker threads, each with its own task queue. Idle workers
+* steal tasks from the back of other queues. Tasks get the index of the
+* worker running them, so they can use per worker scratch data.
+*/
+class ThreadPool
+{
+public:
+    typedef std::function<void(int worker)> Task;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+
+    std::atomic<int> queued_;
+    std::atomic<int> pending_;
+    std::atomic<unsigned int> next_;
+    bool stopping_;
+
+    bool tryPop(int worker, Task &task);
+    void loop(int worker);
+
+public:
+    // threads == 0 means one thread per hardware thread.
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(threads_.size()); }
+
+    void submit(Task task);
+
+    // blocks until all submitted tasks are finished.
+    void wait();
+};
+
+}
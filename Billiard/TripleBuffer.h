@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+namespace billiard {
+
+/**
+* Hands values from one writer thread to one reader thread without locks.
+* The writer fills back() and publishes it, the reader picks up the latest
+* published value with update(). Neither side ever waits for the other,
+* values published between two updates are skipped.
+*/
+template <typename T>
+class TripleBuffer
+{
+    static const int FRESH = 4; // middle holds a value the reader has not seen
+
+    T buffers_[3];
+    std::atomic<int> middle_;
+    int back_; // writer only
+    int front_; // reader only
+
+public:
+    TripleBuffer() : middle_(1), back_(0), front_(2) {}
+
+    TripleBuffer(const TripleBuffer &) = delete;
+    TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+    T &back() { return buffers_[back_]; }
+
+    void publish() {
+        back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & ~FRESH;
+    }
+
+    // swaps in the latest published value, false if there is nothing new.
+    bool update() {
+        if (!(middle_.load(std::memory_order_acquire) & FRESH)) {
+            return false;
+        }
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & ~FRESH;
+        return true;
+    }
+
+    const T &front() const { return buffers_[front_]; }
+};
+
+}
@@ -75,6 +75,14 @@ public:
         glBindBuffer(target, *vbo);
     }
 
+    // indexed binding point of a uniform or transform feedback buffer.
+    template <GLenum target>
+    void bindBase(GLuint index) const {
+        static_assert(target == GL_UNIFORM_BUFFER || target == GL_TRANSFORM_FEEDBACK_BUFFER,
+            "wrong indexed target");
+        glBindBufferBase(target, index, *vbo);
+    }
+
     template <GLenum target>
     static void unbind() {
         checkTarget<target>();
@@ -2,7 +2,6 @@
 #include "utils.h"
 
 #include <fstream>
-#include <cassert>
 #include <Windows.h>
 #include <WinBase.h>
 #include <Dbghelp.h>
@@ -44,40 +43,19 @@ namespace utils {
         return data;
     }
 
-    std::vector<unsigned char> loadPng(const char *filename, 
-            unsigned int *width, unsigned int *height, unsigned int *bpp) {
-        std::vector<unsigned char> result;
-        if (auto bitmap = FreeImage_Load(FIF_PNG, filename)) {
-            *width = FreeImage_GetWidth(bitmap);
-            *height = FreeImage_GetHeight(bitmap);
-            *bpp = FreeImage_GetBPP(bitmap);
-
-            if (*bpp != 24) {
-                auto oldBitmap = bitmap;
-                bitmap = FreeImage_ConvertTo32Bits(oldBitmap);
-                FreeImage_Unload(oldBitmap);
-                *bpp = FreeImage_GetBPP(bitmap);
-            }
-            assert(*bpp == 24 || *bpp == 32);
-
-            auto type = FreeImage_GetImageType(bitmap);
-            auto bits = FreeImage_GetBits(bitmap);
-            
-            auto pitch = FreeImage_GetPitch(bitmap);
-            for (unsigned int y = 0; y < *height; y++) {
-                auto pixel = (BYTE*)bits;
-                for (unsigned int x = 0; x < *width; x++) {
-                    result.push_back(pixel[FI_RGBA_RED]);
-                    result.push_back(pixel[FI_RGBA_GREEN]);
-                    result.push_back(pixel[FI_RGBA_BLUE]);
-                    pixel += *bpp / 8;
-                }
-                // next line
-                bits += pitch;
-            }
-            FreeImage_Unload(bitmap);
+    bool savePng(const char *filename, int width, int height, const unsigned char *bgra) {
+        auto bitmap = FreeImage_ConvertFromRawBits(const_cast<BYTE *>(bgra), width, height, width * 4,
+            32, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, FALSE);
+        if (!bitmap) {
+            LOG(ERROR) << "Cannot convert pixels for " << filename;
+            return false;
         }
-        return result;
+        auto saved = FreeImage_Save(FIF_PNG, bitmap, filename) != 0;
+        if (!saved) {
+            LOG(ERROR) << "Cannot save " << filename;
+        }
+        FreeImage_Unload(bitmap);
+        return saved;
     }
 
     void printStack( void )
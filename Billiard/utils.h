@@ -11,7 +11,9 @@ namespace utils {
     std::string getExePath();
 
     std::vector<char> loadAsset(const std::string &filename);
-    std::vector<unsigned char> loadPng(const char *filename, unsigned int *width, unsigned int *height, unsigned int *bpp);
+
+    // bgra pixels, bottom row first, as glReadPixels returns them.
+    bool savePng(const char *filename, int width, int height, const unsigned char *bgra);
 
     void printStack( void );
 
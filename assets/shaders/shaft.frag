@@ -1,18 +1,8 @@
-uniform vec3  u_ConePos;
-uniform float u_ConeHeight;
-
 uniform sampler2D u_Texture;
 uniform sampler2D u_ShadowMap;
 uniform sampler2DRect u_Depth;
-uniform float u_TanPhi;
-
-uniform float u_Light0SpotExp;
-uniform float u_Light0SpotCosCutoff;
-uniform vec3 u_Light0Pos;
-uniform vec3 u_Light0SpotDir;
-
-uniform float u_NearPlane;
-uniform float u_FarPlane;
+uniform float u_DepthScale; // full resolution pixels per pixel of this pass
+uniform float u_SliceWeight; // keeps the sum of all slices the same for any slice count
 
 out vec4 color;
 
@@ -43,11 +33,18 @@ void main()
     vec4 shadowCoord = v_ShadowCoord / v_ShadowCoord.w;
     float shadow = getVisibility(u_ShadowMap, shadowCoord);
 
-    float dist = clamp(distance(v_EyeVertex, u_ConePos) / u_ConeHeight, 0.0f, 1.0f);
-    float R = dist * u_TanPhi;
-    float alpha = 0.25f * spotEffect / (2.0f * R + 1.0f);
-
-    float zs = texture(u_Depth, gl_FragCoord.xy).r;
+    float dist = clamp(distance(v_EyeVertex, u_Light0Pos) / u_Light0Length, 0.0f, 1.0f);
+    float R = dist * u_Light0TanPhi;
+    float alpha = 0.25f * u_SliceWeight * spotEffect / (2.0f * R + 1.0f);
+
+#ifdef PERSPECTIVE_DEPTH
+    // main pass depth buffer, back to the linear depth the prepass writes
+    float ndc = texture(u_Depth, gl_FragCoord.xy * u_DepthScale).r * 2.0f - 1.0f;
+    float eyeZ = 2.0f * u_NearPlane * u_FarPlane / (u_FarPlane + u_NearPlane - ndc * (u_FarPlane - u_NearPlane));
+    float zs = (eyeZ - u_NearPlane) / (u_FarPlane - u_NearPlane);
+#else
+    float zs = texture(u_Depth, gl_FragCoord.xy * u_DepthScale).r;
+#endif
     float z = (-v_EyeVertex.z - u_NearPlane) / (u_FarPlane - u_NearPlane);
     float dz = smoothstep(0.0f, 0.01f, zs - z);
 
@@ -1,10 +1,3 @@
-uniform mat4 u_DepthBiasMat;
-uniform mat3 u_InverseViewRotMat;
-uniform mat4 u_ModelViewMat;
-uniform mat4 u_ProjectionMat;
-
-uniform float u_ConeHeight;
-
 uniform vec3 u_ConeMin;
 uniform float u_ConeDepth;
 
@@ -22,12 +15,14 @@ float computeClipDistance(vec4 plane, vec3 vertex) {
 
 void main()
 {
+    // view is rigid, so its inverse rotation is the transpose
+    mat3 inverseViewRot = transpose(mat3(u_ViewMat));
     vec4 vertex = vec4(u_ConeMin
-                 + position.x * u_InverseViewRotMat[0] * u_ConeHeight * 2
-                 + position.y * u_InverseViewRotMat[1] * u_ConeHeight * 2
-                 - position.z * u_InverseViewRotMat[2] * u_ConeDepth, 1);
+                 + position.x * inverseViewRot[0] * u_Light0Length * 2
+                 + position.y * inverseViewRot[1] * u_Light0Length * 2
+                 - position.z * inverseViewRot[2] * u_ConeDepth, 1);
 
-    vec4 eyePos = u_ModelViewMat * vertex;
+    vec4 eyePos = u_ViewMat * vertex;
     v_EyeVertex = vec3(eyePos);
     
     v_ShadowCoord = u_DepthBiasMat * vertex;
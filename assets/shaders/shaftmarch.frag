@@ -0,0 +1,154 @@
+uniform sampler2D u_Texture;
+uniform sampler2D u_ShadowMap;
+uniform sampler2DRect u_Depth;
+uniform float u_DepthScale; // full resolution pixels per pixel of this pass
+uniform float u_ConeDepth; // eye depth the slices are spread over
+uniform int u_Steps;
+uniform float u_Jitter; // per frame offset of the samples, in steps
+
+out vec4 color;
+
+#define M_E 2.71828
+#define M_PI 3.14159265
+
+// what the slices draw, see calcConeFrustum
+#define CONE_START 0.5f
+#define CONE_END 1.1f
+#define SLICES 32.0f
+
+float getVisibility(sampler2D shadowMap, vec4 coords) {
+    vec4 vsm = texture(shadowMap, coords.xy);
+    float mu = vsm.x;
+    float s2 = vsm.y - mu * mu;
+    float pmax = s2 / (s2 + (coords.z - mu) * (coords.z - mu));
+
+    return coords.z > vsm.x ? pmax : 1;
+}
+
+float linearDepth(vec2 coord) {
+    float depth = texture(u_Depth, coord).r;
+#ifdef PERSPECTIVE_DEPTH
+    float ndc = depth * 2.0f - 1.0f;
+    float eyeZ = 2.0f * u_NearPlane * u_FarPlane / (u_FarPlane + u_NearPlane - ndc * (u_FarPlane - u_NearPlane));
+    return (eyeZ - u_NearPlane) / (u_FarPlane - u_NearPlane);
+#else
+    return depth;
+#endif
+}
+
+// noise that differs a lot between neighbour pixels, so steps do not band
+float interleavedGradientNoise(vec2 pixel) {
+    return fract(52.9829189f * fract(dot(pixel, vec2(0.06711056f, 0.00583715f))));
+}
+
+/*
+    Where the eye ray t * dir lies inside the light cone, between CONE_START
+    and CONE_END along its axis. False when it misses.
+*/
+bool intersectCone(vec3 dir, out float near, out float far) {
+    vec3 axis = normalize(u_Light0SpotDir);
+    vec3 co = -u_Light0Pos;
+    float cos2 = 1.0f / (1.0f + u_Light0TanPhi * u_Light0TanPhi);
+
+    // inside the double cone where dot(p, axis)^2 > cos2 * dot(p, p)
+    float da = dot(dir, axis);
+    float ca = dot(co, axis);
+    float a = da * da - cos2;
+    float b = 2.0f * (da * ca - cos2 * dot(dir, co));
+    float c = ca * ca - cos2 * dot(co, co);
+    float discriminant = b * b - 4.0f * a * c;
+    if (discriminant < 0 || abs(a) < 1e-6f) {
+        return false;
+    }
+    float root = sqrt(discriminant);
+    float t0 = min((-b - root) / (2.0f * a), (-b + root) / (2.0f * a));
+    float t1 = max((-b - root) / (2.0f * a), (-b + root) / (2.0f * a));
+
+    // one segment for rays steeper than the cone, else two rays on
+    // different nappes, keep the one in front of the light
+    if (a < 0) {
+        near = t0;
+        far = t1;
+        if (ca + da * (t0 + t1) * 0.5f < 0) {
+            return false;
+        }
+    } else if (ca + da * t0 >= 0) {
+        near = -1e30f;
+        far = t0;
+    } else {
+        near = t1;
+        far = 1e30f;
+    }
+
+    // between the start and end planes, along the axis ca + da * t
+    float start = CONE_START;
+    float end = CONE_END * u_Light0Length;
+    if (abs(da) > 1e-6f) {
+        float tStart = (start - ca) / da;
+        float tEnd = (end - ca) / da;
+        near = max(near, min(tStart, tEnd));
+        far = min(far, max(tStart, tEnd));
+    } else if (ca < start || ca > end) {
+        return false;
+    }
+    near = max(near, 0.0f);
+    return near < far;
+}
+
+void main()
+{
+    vec2 fullPixel = gl_FragCoord.xy * u_DepthScale;
+    vec2 ndc = fullPixel / vec2(textureSize(u_Depth)) * 2.0f - 1.0f;
+    vec3 dir = normalize(vec3(ndc.x / u_ProjectionMat[0][0], ndc.y / u_ProjectionMat[1][1], -1.0f));
+
+    float near, far;
+    if (!intersectCone(dir, near, far)) {
+        color = vec4(0);
+        return;
+    }
+
+    // view is rigid, so its inverse rotation is the transpose
+    mat3 inverseViewRot = transpose(mat3(u_ViewMat));
+    vec3 viewOrigin = -inverseViewRot * vec3(u_ViewMat[3]);
+
+    // no sample is spent behind the scene, past where the fade below ends
+    float zs = linearDepth(fullPixel);
+    far = min(far, (u_NearPlane + (zs + 0.01f) * (u_FarPlane - u_NearPlane)) / -dir.z);
+    if (near >= far) {
+        color = vec4(0);
+        return;
+    }
+
+    float step = (far - near) / u_Steps;
+    float offset = fract(interleavedGradientNoise(gl_FragCoord.xy) + u_Jitter);
+
+    // a slice every u_ConeDepth / SLICES of eye depth, each adds what shaft.frag does
+    float sliceDensity = SLICES * step * -dir.z / u_ConeDepth;
+
+    vec3 sum = vec3(0);
+    for (int i = 0; i < u_Steps; i++) {
+        vec3 eyePos = dir * (near + (i + offset) * step);
+
+        vec3 L = normalize(u_Light0Pos - eyePos);
+        float spotEffect = dot(normalize(u_Light0SpotDir), -L);
+        spotEffect = clamp((spotEffect - u_Light0SpotCosCutoff) / (1 - u_Light0SpotCosCutoff), 0, 1)
+                            * min(pow(spotEffect, u_Light0SpotExp), 1.0f);
+
+        vec4 shadowCoord = u_DepthBiasMat * vec4(inverseViewRot * eyePos + viewOrigin, 1);
+        shadowCoord /= shadowCoord.w;
+        float shadow = getVisibility(u_ShadowMap, shadowCoord);
+
+        float dist = clamp(distance(eyePos, u_Light0Pos) / u_Light0Length, 0.0f, 1.0f);
+        float R = dist * u_Light0TanPhi;
+        float alpha = 0.25f * spotEffect / (2.0f * R + 1.0f);
+
+        float z = (-eyePos.z - u_NearPlane) / (u_FarPlane - u_NearPlane);
+        float dz = smoothstep(0.0f, 0.01f, zs - z);
+
+        float cookie = texture(u_Texture, shadowCoord.xy).r;
+        sum += vec3(shadow * cookie * cookie * dz * alpha);
+    }
+
+    // added to the target, or to the history the temporal path keeps
+    color = vec4(sum * sliceDensity, 0);
+}
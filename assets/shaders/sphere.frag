@@ -3,18 +3,13 @@
 #endif
 
 #ifdef NORMAL_PASS
-uniform sampler2D u_Albedo;
-uniform vec3 u_Light0Pos;
-#endif
-
-#ifdef DEPTH_PASS
-uniform float u_NearPlane;
-uniform float u_FarPlane;
+uniform sampler2DArray u_Albedo;
 #endif
 
 out vec4 color;
 
 #ifdef NORMAL_PASS
+flat in int v_Layer;
 in vec3 v_Tesselated;
 in vec3 v_Normal;
 in vec3 v_Eye;
@@ -59,6 +54,6 @@ void main(void)
 
   vec2 albedoTexCoord = vec2(clamp(0.5 + atan(v_Tesselated.y, v_Tesselated.x) / (2 * M_PI), 0, 1), 
                              clamp(0.5 + asin(clamp(v_Tesselated.z, -1, 1)) / M_PI, 0, 1));
-  color = texture2D(u_Albedo, albedoTexCoord) * (AMBIENT * ambient + DIFFUSE * diffuse + SPECULAR * spec);
+  color = texture(u_Albedo, vec3(albedoTexCoord, v_Layer)) * (AMBIENT * ambient + DIFFUSE * diffuse + SPECULAR * spec);
 #endif
 }
\ No newline at end of file
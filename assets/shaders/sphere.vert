@@ -1,12 +1,18 @@
-uniform mat4 u_ModelMat;
-
 layout(location = 0) in vec3 position;
 
+// per instance
+layout(location = 1) in mat4 modelMat;
+layout(location = 5) in ivec2 ball; // number, albedo layer
+
 out vec3 v_WorldPosition;
 out vec3 v_PositionControl;
+out mat4 v_ModelMat;
+out int v_Layer;
 
 void main(void)
 {
     v_PositionControl = position;
-    v_WorldPosition = vec3(u_ModelMat * vec4(position, 1.0));
+    v_WorldPosition = vec3(modelMat * vec4(position, 1.0));
+    v_ModelMat = modelMat;
+    v_Layer = ball.y;
 }
\ No newline at end of file
@@ -1,13 +1,6 @@
 #ifndef DEPTH_PASS
-uniform float u_Light0SpotExp;
-uniform float u_Light0SpotCosCutoff;
-uniform vec3 u_Light0Pos;
-uniform vec3 u_Light0SpotDir;
 uniform sampler2D u_ShadowMap;
 uniform sampler2D u_Texture;
-#else
-uniform float u_NearPlane;
-uniform float u_FarPlane;
 #endif
 
 #ifdef DEPTH_PASS
@@ -1,10 +1,3 @@
-uniform mat4 u_ModelviewProjectionMat;
-uniform mat4 u_ModelviewMat;
-#ifndef DEPTH_PASS
-uniform mat3 u_NormalMat;
-uniform mat4 u_DepthBiasMat;
-#endif
-
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
 layout(location = 2) in vec2 texCoords;
@@ -21,12 +14,12 @@ out vec4 v_ShadowCoords;
 void main(void)
 {
 #ifdef DEPTH_PASS
-    v_Depth = -(u_ModelviewMat * vec4(position, 1)).z;
+    v_Depth = -(u_ViewMat * vec4(position, 1)).z; // table model matrix is identity
 #else
-    v_EyeSpaceVertex = vec3(u_ModelviewMat * vec4(position, 1.0));
-    v_EyeSpaceNormal = u_NormalMat * normal;
+    v_EyeSpaceVertex = vec3(u_ViewMat * vec4(position, 1.0));
+    v_EyeSpaceNormal = mat3(u_ViewMat) * normal; // view is rigid
     v_TexCoords = texCoords;
     v_ShadowCoords = u_DepthBiasMat * vec4(position, 1);
 #endif
-    gl_Position = u_ModelviewProjectionMat * vec4(position, 1.0);
+    gl_Position = u_ViewProjMat * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+uniform sampler2D u_Shafts;
+uniform sampler2DRect u_Depth;
+uniform float u_Divisor; // full resolution pixels per shaft texel
+
+out vec4 color;
+
+// texels across a depth edge barely count
+#define DEPTH_EPSILON 0.001f
+
+float linearDepth(vec2 coord) {
+    float depth = texture(u_Depth, coord).r;
+#ifdef PERSPECTIVE_DEPTH
+    float ndc = depth * 2.0f - 1.0f;
+    float eyeZ = 2.0f * u_NearPlane * u_FarPlane / (u_FarPlane + u_NearPlane - ndc * (u_FarPlane - u_NearPlane));
+    return (eyeZ - u_NearPlane) / (u_FarPlane - u_NearPlane);
+#else
+    return depth;
+#endif
+}
+
+void main()
+{
+    float depth = linearDepth(gl_FragCoord.xy);
+
+    // the four shaft texels around this pixel, weighted bilinearly and by
+    // how close the depth they were rendered at is to this pixel's depth
+    vec2 position = gl_FragCoord.xy / u_Divisor - 0.5f;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    ivec2 size = textureSize(u_Shafts, 0);
+
+    vec4 sum = vec4(0);
+    float weights = 0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), size - 1);
+        vec2 bilinear = mix(1.0f - f, f, vec2(offset));
+        float texelDepth = linearDepth((vec2(texel) + 0.5f) * u_Divisor);
+        float weight = bilinear.x * bilinear.y / (DEPTH_EPSILON + abs(texelDepth - depth));
+        sum += texelFetch(u_Shafts, texel, 0) * weight;
+        weights += weight;
+    }
+    color = sum / max(weights, 1e-6f);
+}